@@ -0,0 +1,143 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <webp/encode.h>
+
+#include "animation.h"
+
+#define QUALITY 70
+#define DURATION 20
+#define HEADER_SIZE 12
+#define VP8X_SIZE 18
+
+static void put(uint8_t *destination, int value, int bytes)
+{
+	for (int index = 0; index < bytes; index++)
+	{
+		destination[index] = value >> (index * 8);
+	}
+}
+
+static int add_chunk(uint8_t *destination, const char *tag, int size)
+{
+	memcpy(destination, tag, 4);
+	put(destination + 4, size, 4);
+	return 8 + size + (size & 1);
+}
+
+// Key frames cover the whole canvas without blending. The frames between them only cover part of the canvas and
+// blend semi-transparent pixels onto it, so they can't be decoded without the frames before them.
+
+uint8_t *animation_create(int width, int height, int frames, int interval, int *size)
+{
+	uint8_t *pixels;
+	uint8_t *data;
+	int capacity = HEADER_SIZE + VP8X_SIZE + 14;
+	int length = 0;
+
+	if ((pixels = malloc(width * height * 4)) == NULL)
+	{
+		perror("Failed to allocate memory for pixels");
+		return NULL;
+	}
+
+	if ((data = malloc(capacity)) == NULL)
+	{
+		perror("Failed to allocate memory for animation");
+		goto free_pixels;
+	}
+
+	memcpy(data, "RIFF\0\0\0\0WEBP", HEADER_SIZE);
+	length = HEADER_SIZE;
+
+	memset(data + length, 0, VP8X_SIZE);
+	add_chunk(data + length, "VP8X", 10);
+	data[length + 8] = 0x12;
+	put(data + length + 12, width - 1, 3);
+	put(data + length + 15, height - 1, 3);
+	length += VP8X_SIZE;
+
+	memset(data + length, 0, 14);
+	length += add_chunk(data + length, "ANIM", 6);
+
+	for (int frame = 0; frame < frames; frame++)
+	{
+		bool key = frame % interval == 0;
+		int frameWidth = key ? width : width / 2 & ~1;
+		int frameHeight = key ? height : height / 2 & ~1;
+		int x = key ? 0 : frame * 34 % (width - frameWidth + 1) & ~1;
+		int y = key ? 0 : frame * 18 % (height - frameHeight + 1) & ~1;
+
+		for (int row = 0; row < frameHeight; row++)
+		{
+			for (int column = 0; column < frameWidth; column++)
+			{
+				uint8_t *pixel = pixels + (row * frameWidth + column) * 4;
+
+				pixel[0] = column * 3 + frame * 7;
+				pixel[1] = row * 5 + frame * 11;
+				pixel[2] = (column ^ row) + frame * 13;
+				pixel[3] = key || (column + row) & 16 ? 255 : 128;
+			}
+		}
+
+		uint8_t *encoded;
+		int encodedSize = WebPEncodeRGBA(pixels, frameWidth, frameHeight, frameWidth * 4, QUALITY, &encoded);
+
+		if (encodedSize == 0)
+		{
+			puts("Failed to encode frame!");
+			goto free_data;
+		}
+
+		// Only the chunks following the RIFF and VP8X headers of the encoded image go into the frame
+		uint8_t *chunks = encoded + HEADER_SIZE;
+		int chunksSize = encodedSize - HEADER_SIZE;
+
+		if (memcmp(chunks, "VP8X", 4) == 0)
+		{
+			chunks += VP8X_SIZE;
+			chunksSize -= VP8X_SIZE;
+		}
+
+		uint8_t *resized;
+		capacity = length + 24 + chunksSize + 1;
+
+		if ((resized = realloc(data, capacity)) == NULL)
+		{
+			perror("Failed to allocate memory for animation");
+			WebPFree(encoded);
+			goto free_data;
+		}
+
+		data = resized;
+
+		uint8_t *chunk = data + length;
+		length += add_chunk(chunk, "ANMF", 16 + chunksSize);
+
+		put(chunk + 8, x / 2, 3);
+		put(chunk + 11, y / 2, 3);
+		put(chunk + 14, frameWidth - 1, 3);
+		put(chunk + 17, frameHeight - 1, 3);
+		put(chunk + 20, DURATION, 3);
+		chunk[23] = key ? 0x02 : 0x00;
+
+		memcpy(chunk + 24, chunks, chunksSize);
+		WebPFree(encoded);
+	}
+
+	put(data + 4, length - 8, 4);
+	free(pixels);
+
+	*size = length;
+	return data;
+
+free_data:
+	free(data);
+
+free_pixels:
+	free(pixels);
+	return NULL;
+}
\ No newline at end of file
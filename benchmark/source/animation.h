@@ -0,0 +1,8 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <stdint.h>
+
+uint8_t *animation_create(int width, int height, int frames, int interval, int *size);
+
+#endif
\ No newline at end of file
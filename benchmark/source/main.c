@@ -0,0 +1,419 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "animation.h"
+#include "colorlight.h"
+#include "decoder.h"
+#include "frame.h"
+#include "host.h"
+#include "pool.h"
+#include "scheduler.h"
+#include "workers.h"
+
+#define ANIMATION_FRAMES 60
+#define HOST_DEADLINE 1000
+#define ROUNDS 5
+
+static int intervals[] = {1, 6, 20, ANIMATION_FRAMES};
+
+bool parse(const char *source, int *destination)
+{
+	char *end;
+	*destination = strtol(source, &end, 10);
+	return end[0] != 0;
+}
+
+double get_time()
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+}
+
+double get_processor_time()
+{
+	struct timespec time;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+	return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+}
+
+// Frames are sent as rows followed by an update, the same way the player sends them, with each backend in turn
+
+bool send_frames(char *port, bool xdp, uint8_t *buffer, int width, int height, int frames)
+{
+	colorlight *colorlight;
+
+	if ((colorlight = colorlight_init(port, xdp)) == NULL)
+	{
+		puts("Failed to create Colorlight instance!");
+		return true;
+	}
+
+	if (xdp && !colorlight_has_xdp(colorlight))
+	{
+		colorlight_destroy(colorlight);
+		return false;
+	}
+
+	double start = get_time();
+	double processor = get_processor_time();
+
+	for (int frame = 0; frame < frames; frame++)
+	{
+		for (int row = 0; row < height; row++)
+		{
+			colorlight_send_row(colorlight, row, width, buffer + row * width * 3);
+		}
+
+		colorlight_send_update(colorlight, 255, 255, 255);
+	}
+
+	double duration = get_time() - start;
+	double used = get_processor_time() - processor;
+	long packets = colorlight_get_packets(colorlight);
+
+	printf("%-10s  %10.0f  %15.1f\n", xdp ? "AF_XDP" : "Raw socket", packets / duration * 1000, used * 1000000 / packets);
+	colorlight_destroy(colorlight);
+
+	return false;
+}
+
+int main(int argc, char *argv[])
+{
+	int status = EXIT_FAILURE;
+	int width = 1024;
+	int height = 512;
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int frames = 200;
+	int count = 2;
+	int mix = 0;
+	int interval = 0;
+	char *port = NULL;
+
+	for (int index = 1; index < argc; index++)
+	{
+		char *argument = argv[index];
+		bool failed = argument[0] != '-';
+
+		switch (failed ? 0 : argument[1])
+		{
+			case 'w':
+				failed = ++index >= argc || parse(argv[index], &width);
+				break;
+
+			case 'h':
+				failed = ++index >= argc || parse(argv[index], &height);
+				break;
+
+			case 't':
+				failed = ++index >= argc || parse(argv[index], &threads);
+				break;
+
+			case 'f':
+				failed = ++index >= argc || parse(argv[index], &frames);
+				break;
+
+			case 'c':
+				failed = ++index >= argc || parse(argv[index], &count);
+				break;
+
+			case 'm':
+				failed = ++index >= argc || parse(argv[index], &mix);
+				break;
+
+			case 'k':
+				failed = ++index >= argc || parse(argv[index], &interval);
+				break;
+
+			case 'p':
+				failed = ++index >= argc;
+				port = argv[index];
+				break;
+
+			default:
+				failed = true;
+		}
+
+		if (failed || argument[2] != 0)
+		{
+			puts("Usage:");
+			puts("  benchmark [options]");
+			puts("");
+			puts("Options:");
+			puts("  -w <width>   Set frame width");
+			puts("  -h <height>  Set frame height");
+			puts("  -t <threads> Set maximum thread count");
+			puts("  -f <frames>  Set frames per measurement");
+			puts("  -c <count>   Set number of blended sources");
+			puts("  -m <mix>     Set frame mixing percentage");
+			puts("  -k <frames>  Set animation key frame interval");
+			puts("  -p <port>    Send frames on ethernet port");
+
+			goto exit;
+		}
+	}
+
+	if (width < 1 || height < 1 || threads < 1 || frames < 1)
+	{
+		puts("Width, height, threads and frames must be positive integers!");
+		goto exit;
+	}
+
+	if (count < 1 || count > FRAME_SOURCES)
+	{
+		printf("Count must be an integer between 1 and %d!\n", FRAME_SOURCES);
+		goto exit;
+	}
+
+	if (mix < 0 || mix >= MIX_MAXIMUM)
+	{
+		printf("Mix must be an integer between 0 and %d!\n", MIX_MAXIMUM - 1);
+		goto exit;
+	}
+
+	if (interval < 0)
+	{
+		puts("Key frame interval must be a positive integer!");
+		goto exit;
+	}
+
+	uint8_t *buffer;
+	uint8_t *sources[FRAME_SOURCES];
+	int weights[FRAME_SOURCES];
+	int created = 0;
+
+	if ((buffer = calloc(width * height, 3)) == NULL)
+	{
+		perror("Failed to allocate memory for buffer");
+		goto exit;
+	}
+
+	for (; created < count; created++)
+	{
+		if ((sources[created] = malloc(width * height * 4)) == NULL)
+		{
+			perror("Failed to allocate memory for source");
+			goto free_sources;
+		}
+
+		for (int index = 0; index < width * height * 4; index++)
+		{
+			sources[created][index] = rand();
+		}
+
+		weights[created] = FADE_MAXIMUM / count + (created < FADE_MAXIMUM % count);
+	}
+
+	printf("Composing %d source%s at %dx%d in %d stripes.\n", count, count == 1 ? "" : "s", width, height, frame_get_stripes(width, height));
+	printf("Threads  Frame (ms)  Speedup  Statistics (ms)  Overhead\n");
+
+	double single = 0;
+
+	for (int thread = 1; thread <= threads; thread++)
+	{
+		workers *workers;
+
+		if ((workers = workers_init(thread, frame_get_stripes(width, height))) == NULL)
+		{
+			puts("Failed to create workers instance!");
+			goto free_sources;
+		}
+
+		double durations[2] = {0, 0};
+		frame_statistics statistics;
+
+		// Frames are composed without and then with statistics gathered in the same pass to show what they cost. Both
+		// are measured in turn over several rounds and the fastest round of each is kept, so anything else running on
+		// the machine affects them alike.
+		for (int round = 0; round < ROUNDS; round++)
+		{
+			for (int measured = 0; measured < 2; measured++)
+			{
+				// The first frame warms up the caches and wakes every thread before timing starts
+				frame_compose(workers, buffer, sources, weights, count, width, height, mix, measured ? &statistics : NULL, NULL, NULL);
+
+				double start = get_time();
+
+				for (int frame = 0; frame < frames; frame++)
+				{
+					frame_compose(workers, buffer, sources, weights, count, width, height, mix, measured ? &statistics : NULL, NULL, NULL);
+				}
+
+				double duration = (get_time() - start) / frames;
+
+				if (round == 0 || duration < durations[measured])
+				{
+					durations[measured] = duration;
+				}
+			}
+		}
+
+		if (thread == 1)
+		{
+			single = durations[0];
+		}
+
+		printf("%7d  %10.3f  %6.2fx  %15.3f  %7.1f%%\n", thread, durations[0], single / durations[0], durations[1], (durations[1] / durations[0] - 1) * 100);
+		workers_destroy(workers);
+	}
+
+	host *host;
+
+	// Every worker thread has been joined by now, which the host process needs as it is started with a fork
+	if ((host = host_init(NULL, width, height, HOST_DEADLINE)) == NULL)
+	{
+		puts("Failed to create host instance!");
+		goto free_sources;
+	}
+
+	if (host_wait(host))
+	{
+		puts("Failed to start host!");
+		host_destroy(host);
+		goto free_sources;
+	}
+
+	printf("\nHanding %d frames at %dx%d to an extension host.\n", frames, width, height);
+	printf("Handoff (us)  Handback (us)  Round trip (us)  Copy (us)\n");
+
+	// Frames are handed over in place, so copying a frame is timed alongside for comparison
+	host_update(host, NULL);
+	memcpy(host_get_buffer(host), buffer, width * height * 3);
+
+	double start = get_time();
+
+	for (int frame = 0; frame < frames; frame++)
+	{
+		host_update(host, NULL);
+	}
+
+	double roundTrip = (get_time() - start) / frames;
+	start = get_time();
+
+	for (int frame = 0; frame < frames; frame++)
+	{
+		memcpy(host_get_buffer(host), buffer, width * height * 3);
+	}
+
+	double copy = (get_time() - start) / frames;
+	int handed;
+	int missed;
+	long handoff;
+	long handback;
+
+	host_get_latency(host, &handed, &missed, &handoff, &handback);
+	printf("%12ld  %13ld  %15.1f  %9.1f\n", handoff, handback, roundTrip * 1000, copy * 1000);
+	host_destroy(host);
+
+	if (port != NULL)
+	{
+		printf("\nSending %d frames of %d rows on %s.\n", frames, height, port);
+		printf("Backend     Packets/s  CPU (ns/packet)\n");
+
+		if (send_frames(port, false, buffer, width, height, frames) || send_frames(port, true, buffer, width, height, frames))
+		{
+			goto free_sources;
+		}
+	}
+
+	pool *pool;
+
+	if ((pool = pool_init(false)) == NULL)
+	{
+		puts("Failed to create pool instance!");
+		goto free_sources;
+	}
+
+	// Animations are decoded whole with every thread count, one key frame interval at a time
+	for (int index = 0; index < sizeof(intervals) / sizeof(*intervals); index++)
+	{
+		int keyInterval = interval > 0 ? interval : intervals[index];
+		uint8_t *animation;
+		int size;
+
+		if ((animation = animation_create(width, height, ANIMATION_FRAMES, keyInterval, &size)) == NULL)
+		{
+			puts("Failed to create animation!");
+			goto destroy_pool;
+		}
+
+		printf("\nDecoding %d frames at %dx%d with a key frame every %d frames.\n", ANIMATION_FRAMES, width, height, keyInterval);
+		printf("Threads  Frame (ms)  Speedup\n");
+
+		for (int thread = 1; thread <= threads; thread++)
+		{
+			scheduler *scheduler = NULL;
+
+			if (thread > 1 && (scheduler = scheduler_init(thread)) == NULL)
+			{
+				puts("Failed to create scheduler instance!");
+				free(animation);
+				goto destroy_pool;
+			}
+
+			double start = get_time();
+			decoder *decoder;
+
+			if ((decoder = decoder_init(animation, size, width, height, thread, scheduler, pool)) == NULL)
+			{
+				puts("Failed to create decoder instance!");
+
+				if (scheduler != NULL)
+				{
+					scheduler_destroy(scheduler);
+				}
+
+				free(animation);
+				goto destroy_pool;
+			}
+
+			int timestamp;
+
+			while (decoder_has_next(decoder) && decoder_get_next(decoder, &timestamp) != NULL);
+
+			decoder_destroy(decoder);
+
+			double duration = (get_time() - start) / ANIMATION_FRAMES;
+
+			if (scheduler != NULL)
+			{
+				scheduler_destroy(scheduler);
+			}
+
+			if (thread == 1)
+			{
+				single = duration;
+			}
+
+			printf("%7d  %10.3f  %6.2fx\n", thread, duration, single / duration);
+		}
+
+		free(animation);
+
+		if (interval > 0)
+		{
+			break;
+		}
+	}
+
+	status = EXIT_SUCCESS;
+
+destroy_pool:
+	pool_destroy(pool);
+
+free_sources:
+	while (created > 0)
+	{
+		free(sources[--created]);
+	}
+
+	free(buffer);
+
+exit:
+	return status;
+}
\ No newline at end of file
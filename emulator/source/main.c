@@ -0,0 +1,338 @@
+#include <math.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "receiver.h"
+
+#define MAX_PIXELS 497
+#define REPORT_DELAY 1000000
+
+static volatile bool running = true;
+
+typedef struct
+{
+	long frames;
+	long keepAlives;
+	long rows;
+	long brightness;
+	long missing;
+	long duplicated;
+	long invalid;
+	long intervals;
+	double intervalSum;
+	double intervalSquares;
+	double firstLatency;
+	double lastLatency;
+} statistics;
+
+bool parse(const char *source, int *destination)
+{
+	char *end;
+	*destination = strtol(source, &end, 10);
+	return end[0] != 0;
+}
+
+long get_time()
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000000 + time.tv_nsec / 1000;
+}
+
+void stop(int signal)
+{
+	running = false;
+}
+
+void report(const char *label, statistics *current, double seconds)
+{
+	double mean = current->intervals > 0 ? current->intervalSum / current->intervals : 0;
+	double variance = current->intervals > 0 ? current->intervalSquares / current->intervals - mean * mean : 0;
+	long updates = current->frames - current->keepAlives;
+
+	printf("%s: %.1f frames/s, %ld keep-alives, %ld rows, %ld brightness, %ld missing, %ld duplicated, %ld invalid.\n", label, current->frames / seconds, current->keepAlives, current->rows, current->brightness, current->missing, current->duplicated, current->invalid);
+
+	if (updates > 0)
+	{
+		printf("  Interval %.2f ms, jitter %.2f ms, latency %.2f ms from first row, %.2f ms from last row.\n", mean / 1000, sqrt(variance > 0 ? variance : 0) / 1000, current->firstLatency / updates / 1000, current->lastLatency / updates / 1000);
+	}
+}
+
+void add(statistics *total, statistics *current)
+{
+	total->frames += current->frames;
+	total->keepAlives += current->keepAlives;
+	total->rows += current->rows;
+	total->brightness += current->brightness;
+	total->missing += current->missing;
+	total->duplicated += current->duplicated;
+	total->invalid += current->invalid;
+	total->intervals += current->intervals;
+	total->intervalSum += current->intervalSum;
+	total->intervalSquares += current->intervalSquares;
+	total->firstLatency += current->firstLatency;
+	total->lastLatency += current->lastLatency;
+}
+
+bool dump(const char *directory, long frame, uint8_t *image, int width, int height)
+{
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/%06ld.ppm", directory, frame);
+
+	FILE *file;
+
+	if ((file = fopen(path, "wb")) == NULL)
+	{
+		perror("Failed to open dump file");
+		return true;
+	}
+
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+
+	// Image data is stored as received in BGR order but PPM expects RGB
+	for (int pixel = 0; pixel < width * height * 3; pixel += 3)
+	{
+		uint8_t rgb[] = {image[pixel + 2], image[pixel + 1], image[pixel]};
+		fwrite(rgb, 1, 3, file);
+	}
+
+	fclose(file);
+	return false;
+}
+
+int main(int argc, char *argv[])
+{
+	int status = EXIT_FAILURE;
+	char *port = NULL;
+	int width = 0;
+	int height = 0;
+	char *dumpDirectory = NULL;
+
+	for (int index = 1; index < argc; index++)
+	{
+		char *argument = argv[index];
+		bool failed = argument[0] != '-';
+
+		switch (failed ? 0 : argument[1])
+		{
+			case 'p':
+				failed = ++index >= argc;
+				port = argv[index];
+				break;
+
+			case 'w':
+				failed = ++index >= argc || parse(argv[index], &width);
+				break;
+
+			case 'h':
+				failed = ++index >= argc || parse(argv[index], &height);
+				break;
+
+			case 'd':
+				failed = ++index >= argc;
+				dumpDirectory = argv[index];
+				break;
+
+			default:
+				failed = true;
+		}
+
+		if (failed || argument[2] != 0)
+		{
+			puts("Usage:");
+			puts("  emulator -p <port> -w <width> -h <height> [options]");
+			puts("");
+			puts("Options:");
+			puts("  -p <port>      Set ethernet port");
+			puts("  -w <width>     Set display width");
+			puts("  -h <height>    Set display height");
+			puts("  -d <directory> Dump displayed frames to directory");
+
+			goto exit;
+		}
+	}
+
+	if (port == NULL)
+	{
+		puts("Port must be specified!");
+		goto exit;
+	}
+
+	if (width < 1 || height < 1)
+	{
+		puts("Width and height must be specified as positive integers!");
+		goto exit;
+	}
+
+	int slices = (width + MAX_PIXELS - 1) / MAX_PIXELS;
+	uint8_t *image;
+	uint8_t *received;
+
+	if ((image = calloc(width * height, 3)) == NULL)
+	{
+		perror("Failed to allocate memory for image");
+		goto exit;
+	}
+
+	// Each row slice is counted so lost and repeated packets can be identified per frame
+	if ((received = calloc(height * slices, 1)) == NULL)
+	{
+		perror("Failed to allocate memory for slice counts");
+		goto free_image;
+	}
+
+	receiver *receiver;
+
+	if ((receiver = receiver_init(port)) == NULL)
+	{
+		puts("Failed to initialise receiver!");
+		goto free_received;
+	}
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+
+	statistics total = {0};
+	statistics current = {0};
+	long begin = get_time();
+	long reported = begin;
+	long previousDisplay = 0;
+	long firstRow = 0;
+	long lastRow = 0;
+	bool pending = false;
+
+	while (running)
+	{
+		uint8_t *packet;
+		int length = receiver_read(receiver, &packet);
+
+		if (length == -1)
+		{
+			goto destroy_receiver;
+		}
+
+		long now = get_time();
+
+		if (length > 0 && packet[0] == 0x55)
+		{
+			int row = packet[1] << 8 | packet[2];
+			int offset = packet[3] << 8 | packet[4];
+			int pixels = packet[5] << 8 | packet[6];
+
+			if (length < 9 + pixels * 3 || row >= height || offset % MAX_PIXELS != 0 || offset + pixels > width)
+			{
+				current.invalid++;
+				continue;
+			}
+
+			memcpy(image + (row * width + offset) * 3, packet + 9, pixels * 3);
+
+			if (received[row * slices + offset / MAX_PIXELS] < UINT8_MAX)
+			{
+				received[row * slices + offset / MAX_PIXELS]++;
+			}
+
+			if (!pending)
+			{
+				firstRow = now;
+				pending = true;
+			}
+
+			lastRow = now;
+			current.rows++;
+		}
+		else if (length > 0 && packet[0] == 0x01)
+		{
+			if (previousDisplay != 0)
+			{
+				double interval = now - previousDisplay;
+				current.intervals++;
+				current.intervalSum += interval;
+				current.intervalSquares += interval * interval;
+			}
+
+			previousDisplay = now;
+			current.frames++;
+
+			// A display packet with no new rows only keeps the current image shown
+			if (!pending)
+			{
+				current.keepAlives++;
+			}
+			else
+			{
+				// Updates can cover only some rows, so slices are only counted as missing within rows that were sent
+				for (int row = 0; row < height; row++)
+				{
+					uint8_t *counts = received + row * slices;
+					int sent = 0;
+
+					for (int slice = 0; slice < slices; slice++)
+					{
+						sent += counts[slice] > 0;
+					}
+
+					if (sent == 0)
+					{
+						continue;
+					}
+
+					current.missing += slices - sent;
+
+					for (int slice = 0; slice < slices; slice++)
+					{
+						if (counts[slice] > 1)
+						{
+							current.duplicated += counts[slice] - 1;
+						}
+					}
+				}
+
+				current.firstLatency += now - firstRow;
+				current.lastLatency += now - lastRow;
+
+				memset(received, 0, height * slices);
+				pending = false;
+
+				if (dumpDirectory != NULL && dump(dumpDirectory, total.frames + current.frames, image, width, height))
+				{
+					goto destroy_receiver;
+				}
+			}
+		}
+		else if (length > 0 && packet[0] == 0x0A)
+		{
+			current.brightness++;
+		}
+
+		if (now - reported >= REPORT_DELAY)
+		{
+			report("Last second", &current, (now - reported) / 1000000.0);
+			add(&total, &current);
+			memset(&current, 0, sizeof(current));
+			reported = now;
+		}
+	}
+
+	add(&total, &current);
+	report("Total", &total, (get_time() - begin) / 1000000.0);
+
+	status = EXIT_SUCCESS;
+
+destroy_receiver:
+	receiver_destroy(receiver);
+
+free_received:
+	free(received);
+
+free_image:
+	free(image);
+
+exit:
+	return status;
+}
\ No newline at end of file
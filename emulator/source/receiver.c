@@ -0,0 +1,129 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "receiver.h"
+
+#define BUFFER_SIZE 2048
+#define TIMEOUT 100000
+#define RECEIVE_BUFFER 16777216
+
+struct receiver
+{
+	int socket;
+	uint8_t buffer[BUFFER_SIZE];
+};
+
+static uint8_t frameHeader[] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x22, 0x22, 0x33, 0x44, 0x55, 0x66};
+
+receiver *receiver_init(char *interfaceName)
+{
+	receiver *instance;
+
+	if ((instance = calloc(1, sizeof(*instance))) == NULL)
+	{
+		perror("Failed to allocate memory for instance");
+		return NULL;
+	}
+
+	if ((instance->socket = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))) == -1)
+	{
+		perror("Failed to create socket");
+		goto free_instance;
+	}
+
+	struct ifreq request;
+	memset(&request, 0, sizeof(request));
+	strcpy(request.ifr_name, interfaceName);
+
+	if (ioctl(instance->socket, SIOCGIFINDEX, &request) == -1)
+	{
+		perror("Failed to find interface");
+		goto close_socket;
+	}
+
+	struct sockaddr_ll address;
+	memset(&address, 0, sizeof(address));
+
+	address.sll_family = AF_PACKET;
+	address.sll_protocol = htons(ETH_P_ALL);
+	address.sll_ifindex = request.ifr_ifindex;
+
+	if (bind(instance->socket, (struct sockaddr *)&address, sizeof(address)) == -1)
+	{
+		perror("Failed to bind socket");
+		goto close_socket;
+	}
+
+	// Whole frames arrive in a single burst so the receive buffer must hold many rows
+	int bufferSize = RECEIVE_BUFFER;
+
+	if (setsockopt(instance->socket, SOL_SOCKET, SO_RCVBUFFORCE, &bufferSize, sizeof(bufferSize)) == -1 && setsockopt(instance->socket, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize)) == -1)
+	{
+		perror("Failed to set socket receive buffer size");
+		goto close_socket;
+	}
+
+	// Reads time out so statistics can still be reported while nothing is being received
+	struct timeval timeout = {
+		.tv_usec = TIMEOUT
+	};
+
+	if (setsockopt(instance->socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == -1)
+	{
+		perror("Failed to set socket timeout");
+		goto close_socket;
+	}
+
+	return instance;
+
+close_socket:
+	close(instance->socket);
+
+free_instance:
+	free(instance);
+	return NULL;
+}
+
+int receiver_read(receiver *instance, uint8_t **packet)
+{
+	struct sockaddr_ll address;
+	socklen_t addressLength = sizeof(address);
+
+	int length = recvfrom(instance->socket, instance->buffer, BUFFER_SIZE, 0, (struct sockaddr *)&address, &addressLength);
+
+	if (length == -1)
+	{
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+		{
+			return 0;
+		}
+
+		perror("Failed to receive packet");
+		return -1;
+	}
+
+	// Packets sent from this machine are also seen on the interface when testing over loopback
+	if (address.sll_pkttype == PACKET_OUTGOING || length <= sizeof(frameHeader) || memcmp(instance->buffer, frameHeader, sizeof(frameHeader)))
+	{
+		return 0;
+	}
+
+	*packet = instance->buffer + sizeof(frameHeader);
+	return length - sizeof(frameHeader);
+}
+
+void receiver_destroy(receiver *instance)
+{
+	close(instance->socket);
+	free(instance);
+}
\ No newline at end of file
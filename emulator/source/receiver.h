@@ -0,0 +1,12 @@
+#ifndef RECEIVER_H
+#define RECEIVER_H
+
+#include <stdint.h>
+
+typedef struct receiver receiver;
+
+receiver *receiver_init(char *interfaceName);
+int receiver_read(receiver *instance, uint8_t **packet);
+void receiver_destroy(receiver *instance);
+
+#endif
\ No newline at end of file
@@ -1,26 +1,286 @@
+#include <errno.h>
 #include <linux/if_ether.h>
 #include <linux/if_packet.h>
+#include <linux/if_xdp.h>
 #include <net/if.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "colorlight.h"
 
 #define MAX_PIXELS 497
+#define XDP_FRAMES 512
+#define XDP_FRAME_SIZE 2048
+#define XDP_BATCH 32
+#define XDP_TIMEOUT 20
+
+typedef struct colorlight_ring
+{
+	uint32_t *producer;
+	uint32_t *consumer;
+	uint32_t *flags;
+	void *descriptors;
+	void *mapping;
+	size_t length;
+} colorlight_ring;
 
 struct colorlight
 {
 	int socket;
 	struct msghdr message;
+	long packets;
+	int xdp;
+	uint8_t *umem;
+	colorlight_ring transmit;
+	colorlight_ring completion;
+	uint32_t available[XDP_FRAMES];
+	int availableLength;
+	int pending;
+	bool stalled;
 };
 
 static uint8_t frameHeader[] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x22, 0x22, 0x33, 0x44, 0x55, 0x66};
 
-colorlight *colorlight_init(char *interface)
+static bool map_ring(colorlight_ring *ring, int socket, struct xdp_ring_offset *offsets, size_t descriptor, off_t page)
+{
+	ring->length = offsets->desc + XDP_FRAMES * descriptor;
+	ring->mapping = mmap(NULL, ring->length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, socket, page);
+
+	if (ring->mapping == MAP_FAILED)
+	{
+		ring->mapping = NULL;
+		return true;
+	}
+
+	ring->producer = (uint32_t *)((uint8_t *)ring->mapping + offsets->producer);
+	ring->consumer = (uint32_t *)((uint8_t *)ring->mapping + offsets->consumer);
+	ring->flags = (uint32_t *)((uint8_t *)ring->mapping + offsets->flags);
+	ring->descriptors = (uint8_t *)ring->mapping + offsets->desc;
+
+	return false;
+}
+
+static void close_xdp(colorlight *instance)
+{
+	if (instance->transmit.mapping != NULL)
+	{
+		munmap(instance->transmit.mapping, instance->transmit.length);
+	}
+
+	if (instance->completion.mapping != NULL)
+	{
+		munmap(instance->completion.mapping, instance->completion.length);
+	}
+
+	if (instance->umem != NULL)
+	{
+		munmap(instance->umem, XDP_FRAMES * XDP_FRAME_SIZE);
+	}
+
+	if (instance->xdp >= 0)
+	{
+		close(instance->xdp);
+	}
+
+	instance->xdp = -1;
+	instance->umem = NULL;
+	memset(&instance->transmit, 0, sizeof(instance->transmit));
+	memset(&instance->completion, 0, sizeof(instance->completion));
+}
+
+// Packets are written into frames of memory registered with an AF_XDP socket and handed to the driver through a ring,
+// which skips the queueing layers a raw socket goes through. Only transmission is needed, so no XDP program has to be
+// attached, and copy mode is used as it works with every driver including veth. Every frame starts out holding the
+// Ethernet header so only the row header and pixels are written for each packet.
+
+static bool open_xdp(colorlight *instance, int index)
+{
+	if ((instance->xdp = socket(AF_XDP, SOCK_RAW, 0)) == -1)
+	{
+		perror("Failed to create AF_XDP socket");
+		return true;
+	}
+
+	instance->umem = mmap(NULL, XDP_FRAMES * XDP_FRAME_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+
+	if (instance->umem == MAP_FAILED)
+	{
+		instance->umem = NULL;
+		perror("Failed to map packet memory");
+		goto close_xdp;
+	}
+
+	struct xdp_umem_reg registration = {
+		.addr = (uintptr_t)instance->umem,
+		.len = XDP_FRAMES * XDP_FRAME_SIZE,
+		.chunk_size = XDP_FRAME_SIZE
+	};
+
+	int size = XDP_FRAMES;
+
+	// The kernel insists on a fill ring even though nothing is ever received
+	if (setsockopt(instance->xdp, SOL_XDP, XDP_UMEM_REG, &registration, sizeof(registration)) == -1 || setsockopt(instance->xdp, SOL_XDP, XDP_UMEM_FILL_RING, &size, sizeof(size)) == -1 || setsockopt(instance->xdp, SOL_XDP, XDP_UMEM_COMPLETION_RING, &size, sizeof(size)) == -1 || setsockopt(instance->xdp, SOL_XDP, XDP_TX_RING, &size, sizeof(size)) == -1)
+	{
+		perror("Failed to configure AF_XDP socket");
+		goto close_xdp;
+	}
+
+	struct xdp_mmap_offsets offsets;
+	socklen_t length = sizeof(offsets);
+
+	if (getsockopt(instance->xdp, SOL_XDP, XDP_MMAP_OFFSETS, &offsets, &length) == -1)
+	{
+		perror("Failed to get AF_XDP ring offsets");
+		goto close_xdp;
+	}
+
+	if (map_ring(&instance->transmit, instance->xdp, &offsets.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING) || map_ring(&instance->completion, instance->xdp, &offsets.cr, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING))
+	{
+		perror("Failed to map AF_XDP rings");
+		goto close_xdp;
+	}
+
+	struct sockaddr_xdp address = {
+		.sxdp_family = AF_XDP,
+		.sxdp_ifindex = index,
+		.sxdp_flags = XDP_COPY | XDP_USE_NEED_WAKEUP
+	};
+
+	if (bind(instance->xdp, (struct sockaddr *)&address, sizeof(address)) == -1)
+	{
+		perror("Failed to bind AF_XDP socket");
+		goto close_xdp;
+	}
+
+	for (int frame = 0; frame < XDP_FRAMES; frame++)
+	{
+		memcpy(instance->umem + frame * XDP_FRAME_SIZE, frameHeader, sizeof(frameHeader));
+		instance->available[frame] = frame;
+	}
+
+	instance->availableLength = XDP_FRAMES;
+	return false;
+
+close_xdp:
+	close_xdp(instance);
+	return true;
+}
+
+// Frames come back through the completion ring once the driver is done with them, in whatever order it finished
+
+static void reclaim(colorlight *instance)
+{
+	colorlight_ring *ring = &instance->completion;
+	uint32_t produced = __atomic_load_n(ring->producer, __ATOMIC_ACQUIRE);
+	uint32_t consumed = *ring->consumer;
+	uint64_t *addresses = ring->descriptors;
+
+	for (; consumed != produced; consumed++)
+	{
+		instance->available[instance->availableLength++] = addresses[consumed % XDP_FRAMES] / XDP_FRAME_SIZE;
+	}
+
+	__atomic_store_n(ring->consumer, consumed, __ATOMIC_RELEASE);
+}
+
+static long get_milliseconds()
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	return time.tv_sec * 1000 + time.tv_nsec / 1000000;
+}
+
+// In copy mode each wakeup only sends a limited batch, so the kernel is woken until it has taken every packet. Packets
+// are sent in ring order, which keeps rows ahead of the update that follows them. A link that is down or a driver that
+// has stalled is only waited on for so long, after which packets that can't be sent are dropped as they would be with
+// a raw socket. Frames already in the ring come back whenever the driver gets to them, and the error is only reported
+// once until packets are moving again.
+
+static void flush(colorlight *instance)
+{
+	colorlight_ring *ring = &instance->transmit;
+	long deadline = get_milliseconds() + (instance->stalled ? 0 : XDP_TIMEOUT);
+	int error = 0;
+
+	while (__atomic_load_n(ring->consumer, __ATOMIC_ACQUIRE) != *ring->producer)
+	{
+		if (get_milliseconds() > deadline)
+		{
+			error = ETIMEDOUT;
+			break;
+		}
+
+		if (!(__atomic_load_n(ring->flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP))
+		{
+			sched_yield();
+			continue;
+		}
+
+		if (sendto(instance->xdp, NULL, 0, MSG_DONTWAIT, NULL, 0) == -1)
+		{
+			if (errno != EAGAIN && errno != EBUSY && errno != ENOBUFS)
+			{
+				error = errno;
+				break;
+			}
+
+			sched_yield();
+		}
+	}
+
+	if (error != 0 && !instance->stalled)
+	{
+		errno = error;
+		perror("Failed to send packets");
+	}
+
+	instance->stalled = error != 0;
+	instance->pending = 0;
+	reclaim(instance);
+}
+
+static void send_xdp(colorlight *instance, uint8_t *header, int headerLength, uint8_t *data, int dataLength)
+{
+	if (instance->availableLength == 0)
+	{
+		flush(instance);
+
+		// Packets are dropped while the driver holds every frame, which flush has already reported
+		if (instance->availableLength == 0)
+		{
+			return;
+		}
+	}
+
+	uint32_t frame = instance->available[--instance->availableLength];
+	uint8_t *packet = instance->umem + frame * XDP_FRAME_SIZE;
+
+	memcpy(packet + sizeof(frameHeader), header, headerLength);
+	memcpy(packet + sizeof(frameHeader) + headerLength, data, dataLength);
+
+	colorlight_ring *ring = &instance->transmit;
+	uint32_t produced = *ring->producer;
+	struct xdp_desc *descriptor = &((struct xdp_desc *)ring->descriptors)[produced % XDP_FRAMES];
+
+	descriptor->addr = frame * XDP_FRAME_SIZE;
+	descriptor->len = sizeof(frameHeader) + headerLength + dataLength;
+	descriptor->options = 0;
+
+	__atomic_store_n(ring->producer, produced + 1, __ATOMIC_RELEASE);
+
+	instance->pending++;
+	instance->packets++;
+}
+
+colorlight *colorlight_init(char *interface, bool xdp)
 {
 	colorlight *instance;
 
@@ -30,6 +290,8 @@ colorlight *colorlight_init(char *interface)
 		return NULL;
 	}
 
+	instance->xdp = -1;
+
 	if ((instance->socket = socket(AF_PACKET, SOCK_RAW, 0)) == -1)
 	{
 		perror("Failed to create socket");
@@ -54,6 +316,12 @@ colorlight *colorlight_init(char *interface)
 		goto close_socket;
 	}
 
+	// The raw socket is kept open either way and carries every packet whenever AF_XDP is unavailable
+	if (xdp && open_xdp(instance, request.ifr_ifindex))
+	{
+		puts("Falling back to raw socket!");
+	}
+
 	address->sll_ifindex = request.ifr_ifindex;
 	address->sll_halen = ETH_ALEN;
 
@@ -77,6 +345,7 @@ colorlight *colorlight_init(char *interface)
 
 free_address:
 	free(address);
+	close_xdp(instance);
 
 close_socket:
 	close(instance->socket);
@@ -110,6 +379,12 @@ void colorlight_send_row(colorlight *instance, uint16_t row, uint16_t width, uin
 		header[5] = pixels >> 8;
 		header[6] = pixels;
 
+		if (instance->xdp >= 0)
+		{
+			send_xdp(instance, header, sizeof(header), data + offset * 3, pixels * 3);
+			continue;
+		}
+
 		instance->message.msg_iov[2].iov_base = data + offset * 3;
 		instance->message.msg_iov[2].iov_len = pixels * 3;
 
@@ -117,6 +392,15 @@ void colorlight_send_row(colorlight *instance, uint16_t row, uint16_t width, uin
 		{
 			perror("Failed to send row data packet");
 		}
+		else
+		{
+			instance->packets++;
+		}
+	}
+
+	if (instance->xdp >= 0 && instance->pending >= XDP_BATCH)
+	{
+		flush(instance);
 	}
 }
 
@@ -131,6 +415,13 @@ void colorlight_send_update(colorlight *instance, uint8_t red, uint8_t green, ui
 	packet[27] = green;
 	packet[28] = blue;
 
+	if (instance->xdp >= 0)
+	{
+		send_xdp(instance, packet, sizeof(packet), NULL, 0);
+		flush(instance);
+		return;
+	}
+
 	instance->message.msg_iov[1].iov_base = packet;
 	instance->message.msg_iov[1].iov_len = sizeof(packet);
 
@@ -138,6 +429,10 @@ void colorlight_send_update(colorlight *instance, uint8_t red, uint8_t green, ui
 	{
 		perror("Failed to send update packet");
 	}
+	else
+	{
+		instance->packets++;
+	}
 }
 
 void colorlight_send_brightness(colorlight *instance, uint8_t red, uint8_t green, uint8_t blue)
@@ -150,6 +445,13 @@ void colorlight_send_brightness(colorlight *instance, uint8_t red, uint8_t green
 	packet[2] = green;
 	packet[3] = blue;
 
+	if (instance->xdp >= 0)
+	{
+		send_xdp(instance, packet, sizeof(packet), NULL, 0);
+		flush(instance);
+		return;
+	}
+
 	instance->message.msg_iov[1].iov_base = packet;
 	instance->message.msg_iov[1].iov_len = sizeof(packet);
 
@@ -157,10 +459,30 @@ void colorlight_send_brightness(colorlight *instance, uint8_t red, uint8_t green
 	{
 		perror("Failed to send brightness packet");
 	}
+	else
+	{
+		instance->packets++;
+	}
+}
+
+long colorlight_get_packets(colorlight *instance)
+{
+	return instance->packets;
+}
+
+bool colorlight_has_xdp(colorlight *instance)
+{
+	return instance->xdp >= 0;
 }
 
 void colorlight_destroy(colorlight *instance)
 {
+	if (instance->xdp >= 0)
+	{
+		flush(instance);
+	}
+
+	close_xdp(instance);
 	close(instance->socket);
 	free(instance->message.msg_iov);
 	free(instance->message.msg_name);
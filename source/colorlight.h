@@ -1,14 +1,17 @@
 #ifndef COLORLIGHT_H
 #define COLORLIGHT_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 typedef struct colorlight colorlight;
 
-colorlight *colorlight_init(char *interfaceName);
+colorlight *colorlight_init(char *interfaceName, bool xdp);
 void colorlight_send_row(colorlight *instance, uint16_t row, uint16_t width, uint8_t *data);
 void colorlight_send_update(colorlight *instance, uint8_t red, uint8_t green, uint8_t blue);
 void colorlight_send_brightness(colorlight *instance, uint8_t red, uint8_t green, uint8_t blue);
+long colorlight_get_packets(colorlight *instance);
+bool colorlight_has_xdp(colorlight *instance);
 void colorlight_destroy(colorlight *instance);
 
 #endif
\ No newline at end of file
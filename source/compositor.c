@@ -0,0 +1,517 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compositor.h"
+#include "frame.h"
+#include "timing.h"
+
+typedef struct compositor_zone
+{
+	compositor *compositor;
+	zone *zone;
+	int x;
+	int y;
+	int width;
+	int height;
+	bool pending;
+	bool initial;
+	bool failed;
+	bool advancing;
+	long expected;
+	long deadline;
+	int shown;
+	frame_statistics statistics;
+} compositor_zone;
+
+struct compositor
+{
+	colorlight *colorlight;
+	scheduler *scheduler;
+	pool *pool;
+	void (*update)();
+	void (*statistics)();
+	host *host;
+	char *name;
+	int width;
+	int height;
+	int brightness;
+	int limit;
+	int level;
+	int mix;
+	frame_statistics measured;
+	bool verbose;
+	uint8_t *buffer;
+	uint8_t *output;
+	bool *dirty;
+	compositor_zone *zones;
+	int zonesLength;
+	bool sending;
+	bool changed;
+	long tick;
+	long updated;
+	long reported;
+	int frames;
+	int missed;
+	long levels;
+	int updates;
+	pthread_mutex_t lock;
+	pthread_cond_t condition;
+};
+
+// Zones later in the list are drawn over earlier ones, so a zone only converts the parts of each row that no later
+// zone covers. This lets any zone be redrawn on its own without disturbing the zones in front of it.
+
+static void convert_span(compositor *instance, int index, uint8_t *frame, int row, int left, int right, int mix, frame_statistics *statistics)
+{
+	compositor_zone *target = &instance->zones[index];
+
+	for (int upper = index + 1; upper < instance->zonesLength && left < right; upper++)
+	{
+		compositor_zone *cover = &instance->zones[upper];
+
+		if (row < cover->y || row >= cover->y + cover->height || cover->x >= right || cover->x + cover->width <= left)
+		{
+			continue;
+		}
+
+		if (cover->x > left)
+		{
+			convert_span(instance, index, frame, row, left, cover->x, mix, statistics);
+		}
+
+		left = cover->x + cover->width;
+	}
+
+	if (left < right)
+	{
+		uint8_t *source = frame + ((row - target->y) * target->width + left - target->x) * 4;
+		frame_convert(instance->buffer + (row * instance->width + left) * 3, source, right - left, mix, statistics);
+	}
+}
+
+static void advance_zone(void *context)
+{
+	compositor_zone *target = context;
+	compositor *instance = target->compositor;
+	bool failed = !zone_advance(target->zone, get_time());
+
+	pthread_mutex_lock(&instance->lock);
+
+	// A frame only misses its deadline if it is still being decoded when it should be on the display
+	if (get_time() > target->deadline)
+	{
+		instance->missed++;
+	}
+
+	target->failed = failed;
+	target->advancing = false;
+	pthread_cond_broadcast(&instance->condition);
+
+	pthread_mutex_unlock(&instance->lock);
+}
+
+// Called with the lock held. Zones that were just shown decode their next frames on the shared scheduler, which runs
+// the job of whichever zone on any display has its rows due first.
+
+static void submit_pending(compositor *instance)
+{
+	for (int index = 0; index < instance->zonesLength; index++)
+	{
+		compositor_zone *target = &instance->zones[index];
+
+		if (!target->pending)
+		{
+			continue;
+		}
+
+		target->pending = false;
+		target->advancing = true;
+		target->expected = zone_get_next_due(target->zone);
+		target->deadline = target->initial ? LONG_MAX : target->expected;
+
+		if (scheduler_submit(instance->scheduler, target->expected - UPDATE_DELAY, advance_zone, target))
+		{
+			puts("Failed to submit decode job!");
+			target->advancing = false;
+			target->failed = true;
+		}
+	}
+}
+
+// Called with the lock held. Zones still being decoded are expected at the time their next frame is due.
+
+static long next_tick(compositor *instance)
+{
+	long tick = instance->updated + HOLD_DELAY;
+
+	for (int index = 0; index < instance->zonesLength; index++)
+	{
+		compositor_zone *target = &instance->zones[index];
+		long due = target->expected;
+
+		if (!target->advancing && zone_get_frame(target->zone, &due) == NULL)
+		{
+			continue;
+		}
+
+		if (due < tick)
+		{
+			tick = due;
+		}
+	}
+
+	return tick;
+}
+
+static void send_rows(compositor *instance)
+{
+	pthread_mutex_lock(&instance->lock);
+
+	long tick = next_tick(instance);
+	bool changed = false;
+
+	for (int index = 0; index < instance->zonesLength; index++)
+	{
+		compositor_zone *target = &instance->zones[index];
+		long due;
+
+		// A frame that is still being decoded when its rows are due is shown at a later tick rather than holding up
+		// the display
+		if (target->advancing)
+		{
+			if (target->expected <= tick)
+			{
+				target->expected = tick + UPDATE_DELAY;
+			}
+
+			continue;
+		}
+
+		if (zone_get_frame(target->zone, &due) == NULL || due > tick)
+		{
+			continue;
+		}
+
+		target->pending = true;
+		changed = true;
+	}
+
+	pthread_mutex_unlock(&instance->lock);
+
+	// Zones marked as pending are not advanced again until the update has been sent, so their frames are stable
+	memset(instance->dirty, 0, instance->height * sizeof(*instance->dirty));
+
+	bool measuring = instance->limit > 0 || instance->statistics != NULL || (instance->host != NULL && host_has_statistics(instance->host));
+
+	for (int index = 0; index < instance->zonesLength; index++)
+	{
+		compositor_zone *target = &instance->zones[index];
+		long due;
+
+		if (!target->pending)
+		{
+			continue;
+		}
+
+		uint8_t *frame = zone_get_frame(target->zone, &due);
+
+		// Zones only cover the parts of the display no later zone covers, so their statistics add up to the whole frame
+		memset(&target->statistics, 0, sizeof(target->statistics));
+
+		for (int row = target->y; row < target->y + target->height; row++)
+		{
+			convert_span(instance, index, frame, row, target->x, target->x + target->width, target->initial ? 0 : instance->mix, measuring ? &target->statistics : NULL);
+			instance->dirty[row] = true;
+		}
+
+		target->initial = false;
+		target->shown++;
+	}
+
+	if (changed && measuring)
+	{
+		frame_statistics *measured = &instance->measured;
+		memset(measured, 0, sizeof(*measured));
+
+		for (int index = 0; index < instance->zonesLength; index++)
+		{
+			frame_merge_statistics(measured, &instance->zones[index].statistics);
+		}
+
+		if (instance->statistics != NULL)
+		{
+			instance->statistics(instance->width * instance->height, measured->sums, measured->histogram, FRAME_BINS, measured->maximum);
+		}
+	}
+
+	uint8_t *output = instance->buffer;
+
+	if (changed && instance->update != NULL)
+	{
+		memcpy(instance->output, instance->buffer, instance->width * instance->height * 3);
+		instance->update(instance->width, instance->height, instance->output);
+		memset(instance->dirty, 1, instance->height * sizeof(*instance->dirty));
+
+		output = instance->output;
+	}
+	else if (changed && instance->host != NULL)
+	{
+		// The extension also works on a copy, as changes it makes would otherwise build up in the rows of zones that
+		// have not advanced
+		uint8_t *extended = host_get_buffer(instance->host);
+		memcpy(extended, instance->buffer, instance->width * instance->height * 3);
+
+		// A frame the extension missed its deadline on is sent as converted, which still replaces every row it changed
+		// in the previous frame
+		output = host_update(instance->host, measuring ? &instance->measured : NULL) ? extended : instance->buffer;
+		memset(instance->dirty, 1, instance->height * sizeof(*instance->dirty));
+	}
+
+	// Only rows covered by zones that advanced are sent again
+	for (int row = 0; row < instance->height; row++)
+	{
+		if (instance->dirty[row])
+		{
+			colorlight_send_row(instance->colorlight, row, instance->width, output + row * instance->width * 3);
+		}
+	}
+
+	instance->tick = tick;
+	instance->changed = changed;
+	instance->sending = true;
+}
+
+static void send_update(compositor *instance)
+{
+	long tick = instance->tick;
+
+	// Ticks that only waited for a late frame send nothing unless the display needs to be held
+	if (instance->changed || tick >= instance->updated + HOLD_DELAY)
+	{
+		// Updates that only hold the display still let the brightness recover from the limit
+		if (instance->limit > 0)
+		{
+			instance->level = frame_limit_brightness(&instance->measured, instance->width * instance->height, instance->brightness, instance->limit, instance->level);
+		}
+
+		colorlight_send_update(instance->colorlight, instance->level, instance->level, instance->level);
+
+		instance->updated = tick;
+		instance->frames += instance->changed;
+		instance->levels += instance->level;
+		instance->updates++;
+	}
+
+	pthread_mutex_lock(&instance->lock);
+	submit_pending(instance);
+	pthread_mutex_unlock(&instance->lock);
+
+	instance->sending = false;
+
+	if (instance->verbose && tick - instance->reported >= REPORT_DELAY)
+	{
+		float seconds = (tick - instance->reported) / 1000.0;
+
+		printf("Display on %s showed %d frames in %.2f seconds at an average rate of %.2f frames per second and missed %d deadlines.\n", instance->name, instance->frames, seconds, instance->frames / seconds, instance->missed);
+
+		for (int index = 0; index < instance->zonesLength; index++)
+		{
+			compositor_zone *target = &instance->zones[index];
+
+			printf("Zone at %d,%d showed %d frames in %.2f seconds at an average rate of %.2f frames per second.\n", target->x, target->y, target->shown, seconds, target->shown / seconds);
+			target->shown = 0;
+		}
+
+		if (instance->host != NULL)
+		{
+			int frames;
+			int missed;
+			long handoff;
+			long handback;
+
+			host_get_latency(instance->host, &frames, &missed, &handoff, &handback);
+			printf("Extension missed the deadline for %d of %d frames and took %ld microseconds to receive frames and %ld microseconds to return them.\n", missed, frames, handoff, handback);
+		}
+
+		if (instance->limit > 0 && instance->updates > 0)
+		{
+			printf("Average brightness after limiting luminance was %.2f.\n", (float)instance->levels / instance->updates);
+		}
+
+		instance->frames = 0;
+		instance->missed = 0;
+		instance->levels = 0;
+		instance->updates = 0;
+		instance->reported = tick;
+	}
+}
+
+compositor *compositor_init(colorlight *colorlight, scheduler *scheduler, char *name, int width, int height, int brightness, int limit, int mix, void (*update)(), void (*statistics)(), host *host, pool *pool, bool verbose)
+{
+	compositor *instance;
+
+	if ((instance = calloc(1, sizeof(*instance))) == NULL)
+	{
+		perror("Failed to allocate memory for instance");
+		return NULL;
+	}
+
+	if ((instance->dirty = calloc(height, sizeof(*instance->dirty))) == NULL)
+	{
+		perror("Failed to allocate memory for dirty rows");
+		goto free_instance;
+	}
+
+	if ((instance->buffer = pool_get(pool, width * height * 3)) == NULL)
+	{
+		puts("Failed to get frame buffer!");
+		goto free_dirty;
+	}
+
+	memset(instance->buffer, 0, width * height * 3);
+
+	// Extensions are given a copy of the frame so changes they make never feed back into later conversions
+	if (update != NULL && (instance->output = pool_get(pool, width * height * 3)) == NULL)
+	{
+		puts("Failed to get output buffer!");
+		goto release_buffer;
+	}
+
+	pthread_mutex_init(&instance->lock, NULL);
+	pthread_cond_init(&instance->condition, NULL);
+
+	instance->colorlight = colorlight;
+	instance->scheduler = scheduler;
+	instance->pool = pool;
+	instance->update = update;
+	instance->statistics = statistics;
+	instance->host = host;
+	instance->name = name;
+	instance->width = width;
+	instance->height = height;
+	instance->brightness = brightness;
+	instance->limit = limit;
+	instance->level = brightness;
+	instance->mix = mix;
+	instance->verbose = verbose;
+	instance->updated = get_time();
+	instance->reported = instance->updated;
+
+	return instance;
+
+release_buffer:
+	pool_release(pool, instance->buffer);
+
+free_dirty:
+	free(instance->dirty);
+
+free_instance:
+	free(instance);
+	return NULL;
+}
+
+bool compositor_add_zone(compositor *instance, zone *zone)
+{
+	compositor_zone *zones;
+
+	if ((zones = realloc(instance->zones, (instance->zonesLength + 1) * sizeof(*zones))) == NULL)
+	{
+		perror("Failed to allocate memory for zones");
+		return true;
+	}
+
+	instance->zones = zones;
+
+	compositor_zone *target = &instance->zones[instance->zonesLength++];
+	memset(target, 0, sizeof(*target));
+
+	target->compositor = instance;
+	target->zone = zone;
+	target->pending = true;
+	target->initial = true;
+
+	zone_get_area(zone, &target->x, &target->y, &target->width, &target->height);
+	return false;
+}
+
+// Every zone must be added before the compositor is started, as decode jobs refer to zones in place
+
+void compositor_start(compositor *instance)
+{
+	pthread_mutex_lock(&instance->lock);
+	submit_pending(instance);
+	pthread_mutex_unlock(&instance->lock);
+}
+
+long compositor_get_event(compositor *instance)
+{
+	if (instance->sending)
+	{
+		return instance->tick;
+	}
+
+	pthread_mutex_lock(&instance->lock);
+	long event = next_tick(instance) - UPDATE_DELAY;
+	pthread_mutex_unlock(&instance->lock);
+
+	return event;
+}
+
+bool compositor_step(compositor *instance)
+{
+	pthread_mutex_lock(&instance->lock);
+
+	// Playback ends with the playlist of the first zone, the others repeat for as long as it lasts
+	bool running = instance->zonesLength > 0 && !instance->zones[0].failed;
+
+	pthread_mutex_unlock(&instance->lock);
+
+	if (!running)
+	{
+		return false;
+	}
+
+	if (instance->sending)
+	{
+		send_update(instance);
+	}
+	else
+	{
+		send_rows(instance);
+	}
+
+	return true;
+}
+
+void compositor_destroy(compositor *instance)
+{
+	pthread_mutex_lock(&instance->lock);
+
+	for (int index = 0; index < instance->zonesLength; index++)
+	{
+		while (instance->zones[index].advancing)
+		{
+			pthread_cond_wait(&instance->condition, &instance->lock);
+		}
+	}
+
+	pthread_mutex_unlock(&instance->lock);
+
+	for (int index = 0; index < instance->zonesLength; index++)
+	{
+		zone_destroy(instance->zones[index].zone);
+	}
+
+	pthread_cond_destroy(&instance->condition);
+	pthread_mutex_destroy(&instance->lock);
+
+	pool_release(instance->pool, instance->output);
+	pool_release(instance->pool, instance->buffer);
+
+	free(instance->zones);
+	free(instance->dirty);
+	free(instance);
+}
\ No newline at end of file
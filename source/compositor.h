@@ -0,0 +1,21 @@
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include <stdbool.h>
+
+#include "colorlight.h"
+#include "host.h"
+#include "pool.h"
+#include "scheduler.h"
+#include "zone.h"
+
+typedef struct compositor compositor;
+
+compositor *compositor_init(colorlight *colorlight, scheduler *scheduler, char *name, int width, int height, int brightness, int limit, int mix, void (*update)(), void (*statistics)(), host *host, pool *pool, bool verbose);
+bool compositor_add_zone(compositor *instance, zone *zone);
+void compositor_start(compositor *instance);
+long compositor_get_event(compositor *instance);
+bool compositor_step(compositor *instance);
+void compositor_destroy(compositor *instance);
+
+#endif
\ No newline at end of file
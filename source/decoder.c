@@ -0,0 +1,678 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <webp/demux.h>
+
+#include "decoder.h"
+#include "scheduler.h"
+
+#define SLOTS_PER_THREAD 8
+#define STREAM_CHUNK 4096
+
+typedef struct decoder_segment
+{
+	int first;
+	int timestamp;
+} decoder_segment;
+
+typedef struct decoder_lane
+{
+	decoder *owner;
+	decoder *decoder;
+	int frame;
+	int last;
+	bool parked;
+} decoder_lane;
+
+struct decoder
+{
+	pool *pool;
+	WebPDemuxer *demuxer;
+	WebPDecoderConfig config;
+	int width;
+	int height;
+	int canvasWidth;
+	int canvasHeight;
+	int frames;
+	int duration;
+	int index;
+	int timestamp;
+	bool *keys;
+	decoder_segment *segments;
+	int segmentCount;
+	bool previousDispose;
+	int disposeX;
+	int disposeY;
+	int disposeWidth;
+	int disposeHeight;
+	uint8_t *canvas;
+	uint8_t *scratch;
+	scheduler *scheduler;
+	decoder_lane *lanes;
+	int laneCount;
+	uint8_t **slots;
+	int *slotTimestamps;
+	bool *slotReady;
+	int slotCount;
+	int consumed;
+	int nextSegment;
+	int active;
+	bool cancelled;
+	pthread_mutex_t lock;
+	pthread_cond_t condition;
+};
+
+static void clear(decoder *instance, int x, int y, int width, int height)
+{
+	for (int row = y; row < y + height; row++)
+	{
+		memset(instance->canvas + (row * instance->width + x) * 4, 0, width * 4);
+	}
+}
+
+static void blend(uint8_t *destination, uint8_t *source, int pixels)
+{
+	for (int pixel = 0; pixel < pixels * 4; pixel += 4)
+	{
+		int sourceAlpha = source[pixel + 3];
+
+		if (sourceAlpha == 255)
+		{
+			memcpy(destination + pixel, source + pixel, 4);
+			continue;
+		}
+
+		if (sourceAlpha == 0)
+		{
+			continue;
+		}
+
+		int destinationAlpha = (destination[pixel + 3] * (256 - sourceAlpha)) >> 8;
+		int alpha = sourceAlpha + destinationAlpha;
+		uint32_t scale = (1 << 24) / alpha;
+
+		for (int channel = 0; channel < 3; channel++)
+		{
+			uint32_t value = source[pixel + channel] * sourceAlpha + destination[pixel + channel] * destinationAlpha;
+			destination[pixel + channel] = (value * scale) >> 24;
+		}
+
+		destination[pixel + 3] = alpha;
+	}
+}
+
+static void place(decoder *instance, WebPIterator *iterator, int first, int last, int decodeWidth, int visibleWidth, bool copy)
+{
+	for (int y = first; y < last; y++)
+	{
+		int row = iterator->y_offset + y;
+		uint8_t *destination = instance->canvas + (row * instance->width + iterator->x_offset) * 4;
+		uint8_t *source = instance->scratch + y * decodeWidth * 4;
+
+		// Pixels inside a rectangle disposed by the previous frame are copied rather than blended
+		int left = 0;
+		int right = copy ? visibleWidth : 0;
+
+		if (!copy && instance->previousDispose && row >= instance->disposeY && row < instance->disposeY + instance->disposeHeight)
+		{
+			left = instance->disposeX - iterator->x_offset;
+			right = left + instance->disposeWidth;
+
+			left = left < 0 ? 0 : (left > visibleWidth ? visibleWidth : left);
+			right = right < left ? left : (right > visibleWidth ? visibleWidth : right);
+		}
+
+		blend(destination, source, left);
+		memcpy(destination + left * 4, source + left * 4, (right - left) * 4);
+		blend(destination + right * 4, source + right * 4, visibleWidth - right);
+	}
+}
+
+static uint8_t *decode(decoder *instance, int *timestamp, decoder_ready_function ready, void *context)
+{
+	WebPIterator iterator;
+
+	if (!WebPDemuxGetFrame(instance->demuxer, ++instance->index, &iterator))
+	{
+		puts("Failed to get frame!");
+		return NULL;
+	}
+
+	bool opaque = !iterator.has_alpha || iterator.blend_method == WEBP_MUX_NO_BLEND;
+	bool key = instance->keys[instance->index - 1];
+
+	if (key)
+	{
+		clear(instance, 0, 0, instance->width, instance->height);
+	}
+	else if (instance->previousDispose)
+	{
+		clear(instance, instance->disposeX, instance->disposeY, instance->disposeWidth, instance->disposeHeight);
+	}
+
+	int visibleWidth = instance->width - iterator.x_offset;
+	int visibleHeight = instance->height - iterator.y_offset;
+
+	if (visibleWidth > iterator.width)
+	{
+		visibleWidth = iterator.width;
+	}
+
+	if (visibleHeight > iterator.height)
+	{
+		visibleHeight = iterator.height;
+	}
+
+	if (visibleWidth < 0 || visibleHeight < 0)
+	{
+		visibleWidth = 0;
+		visibleHeight = 0;
+	}
+
+	if (visibleWidth > 0 && visibleHeight > 0)
+	{
+		WebPDecoderConfig *config = &instance->config;
+
+		// Frames always start at the top left of the visible region, so the crop never needs an offset
+		config->options.use_cropping = visibleWidth < iterator.width || visibleHeight < iterator.height;
+
+		// One pixel past a cropped edge is decoded so lossy chroma upsampling matches a full decode
+		int decodeWidth = visibleWidth + (visibleWidth < iterator.width);
+		int decodeHeight = visibleHeight + (visibleHeight < iterator.height);
+
+		bool copy = key || opaque;
+		bool direct = copy && !config->options.use_cropping;
+
+		config->options.crop_width = decodeWidth;
+		config->options.crop_height = decodeHeight;
+
+		if (direct)
+		{
+			config->output.u.RGBA.rgba = instance->canvas + (iterator.y_offset * instance->width + iterator.x_offset) * 4;
+			config->output.u.RGBA.stride = instance->width * 4;
+		}
+		else
+		{
+			config->output.u.RGBA.rgba = instance->scratch;
+			config->output.u.RGBA.stride = decodeWidth * 4;
+		}
+
+		config->output.u.RGBA.size = config->output.u.RGBA.stride * (decodeHeight - 1) + decodeWidth * 4;
+
+		VP8StatusCode status = VP8_STATUS_OK;
+		int placed = 0;
+
+		if (ready == NULL)
+		{
+			status = WebPDecode(iterator.fragment.bytes, iterator.fragment.size, config);
+		}
+		else
+		{
+			WebPIDecoder *incremental;
+
+			if ((incremental = WebPIDecode(NULL, 0, config)) == NULL)
+			{
+				puts("Failed to create incremental decoder!");
+				WebPDemuxReleaseIterator(&iterator);
+				return NULL;
+			}
+
+			// Rows are placed and handed over as soon as they have been decoded, a chunk of the frame at a time
+			for (size_t length = 0; length < iterator.fragment.size && (status == VP8_STATUS_OK || status == VP8_STATUS_SUSPENDED);)
+			{
+				length = length + STREAM_CHUNK < iterator.fragment.size ? length + STREAM_CHUNK : iterator.fragment.size;
+				status = WebPIUpdate(incremental, iterator.fragment.bytes, length);
+
+				int rows = 0;
+
+				if ((status == VP8_STATUS_OK || status == VP8_STATUS_SUSPENDED) && WebPIDecGetRGB(incremental, &rows, NULL, NULL, NULL) != NULL)
+				{
+					rows = rows < visibleHeight ? rows : visibleHeight;
+				}
+
+				if (rows > placed)
+				{
+					if (!direct)
+					{
+						place(instance, &iterator, placed, rows, decodeWidth, visibleWidth, copy);
+					}
+
+					placed = rows;
+					ready(context, instance->canvas, iterator.y_offset + placed);
+				}
+			}
+
+			WebPIDelete(incremental);
+		}
+
+		if (status != VP8_STATUS_OK)
+		{
+			puts("Failed to decode frame!");
+			WebPDemuxReleaseIterator(&iterator);
+			return NULL;
+		}
+
+		if (!direct)
+		{
+			place(instance, &iterator, placed, visibleHeight, decodeWidth, visibleWidth, copy);
+		}
+	}
+
+	instance->previousDispose = iterator.dispose_method == WEBP_MUX_DISPOSE_BACKGROUND;
+	instance->disposeX = iterator.x_offset;
+	instance->disposeY = iterator.y_offset;
+	instance->disposeWidth = visibleWidth;
+	instance->disposeHeight = visibleHeight;
+
+	instance->timestamp += iterator.duration;
+	*timestamp = instance->timestamp;
+
+	if (ready != NULL)
+	{
+		ready(context, instance->canvas, instance->height);
+	}
+
+	WebPDemuxReleaseIterator(&iterator);
+	return instance->canvas;
+}
+
+// Segments are decoded concurrently by lanes, each with a decoder of its own. A lane decodes one frame at a time into a
+// ring of slots indexed by frame number and is then submitted again with a deadline of how far that frame is ahead of
+// the consumer, so the lanes of every open decoder share the scheduler and the frame needed soonest is decoded first. A
+// lane only writes a frame once the consumer is less than a ring ahead of it and is parked until then, so the lane
+// holding the oldest outstanding frame can always make progress.
+
+static void decode_lane(void *context)
+{
+	decoder_lane *lane = context;
+	decoder *instance = lane->owner;
+
+	pthread_mutex_lock(&instance->lock);
+
+	while (true)
+	{
+		// A lane done with its segment takes the next one nobody has claimed yet
+		if (!instance->cancelled && lane->frame == lane->last && instance->nextSegment < instance->segmentCount)
+		{
+			int segment = instance->nextSegment++;
+
+			lane->frame = instance->segments[segment].first;
+			lane->last = segment + 1 < instance->segmentCount ? instance->segments[segment + 1].first : instance->frames;
+			lane->decoder->index = lane->frame;
+			lane->decoder->timestamp = instance->segments[segment].timestamp;
+			lane->decoder->previousDispose = false;
+		}
+
+		if (instance->cancelled || lane->frame == lane->last)
+		{
+			break;
+		}
+
+		if (lane->frame >= instance->consumed + instance->slotCount)
+		{
+			lane->parked = true;
+			break;
+		}
+
+		pthread_mutex_unlock(&instance->lock);
+
+		int slot = lane->frame % instance->slotCount;
+		int timestamp;
+		uint8_t *canvas = decode(lane->decoder, &timestamp, NULL, NULL);
+
+		if (canvas != NULL)
+		{
+			memcpy(instance->slots[slot], canvas, instance->width * instance->height * 4);
+		}
+
+		pthread_mutex_lock(&instance->lock);
+
+		instance->slotTimestamps[slot] = canvas == NULL ? -1 : timestamp;
+		instance->slotReady[slot] = true;
+		pthread_cond_broadcast(&instance->condition);
+
+		// The consumer stops at a failed frame, so the rest of the segment is abandoned
+		lane->frame = canvas == NULL ? lane->last : lane->frame + 1;
+
+		// A lane that can't be submitted again carries on with its next frame on this thread instead
+		if (!scheduler_submit(instance->scheduler, lane->frame - instance->consumed, decode_lane, lane))
+		{
+			pthread_mutex_unlock(&instance->lock);
+			return;
+		}
+	}
+
+	instance->active--;
+	pthread_cond_broadcast(&instance->condition);
+
+	pthread_mutex_unlock(&instance->lock);
+}
+
+static void stop_lanes(decoder *instance, int lanes)
+{
+	pthread_mutex_lock(&instance->lock);
+
+	// Lanes still queued on the scheduler see the decoder has been cancelled and return straight away
+	instance->cancelled = true;
+
+	while (instance->active > 0)
+	{
+		pthread_cond_wait(&instance->condition, &instance->lock);
+	}
+
+	pthread_mutex_unlock(&instance->lock);
+
+	for (int slot = 0; instance->slots != NULL && slot < instance->slotCount; slot++)
+	{
+		pool_release(instance->pool, instance->slots[slot]);
+	}
+
+	while (lanes > 0)
+	{
+		decoder_destroy(instance->lanes[--lanes].decoder);
+	}
+
+	pthread_cond_destroy(&instance->condition);
+	pthread_mutex_destroy(&instance->lock);
+
+	free(instance->slotReady);
+	free(instance->slotTimestamps);
+	free(instance->slots);
+	free(instance->lanes);
+
+	instance->lanes = NULL;
+}
+
+static bool start_lanes(decoder *instance, void *data, int size, int threads)
+{
+	int lanes = 0;
+
+	instance->laneCount = threads;
+	instance->slotCount = threads * SLOTS_PER_THREAD;
+
+	pthread_mutex_init(&instance->lock, NULL);
+	pthread_cond_init(&instance->condition, NULL);
+
+	instance->lanes = calloc(instance->laneCount, sizeof(*instance->lanes));
+	instance->slots = calloc(instance->slotCount, sizeof(*instance->slots));
+	instance->slotTimestamps = calloc(instance->slotCount, sizeof(*instance->slotTimestamps));
+	instance->slotReady = calloc(instance->slotCount, sizeof(*instance->slotReady));
+
+	if (instance->lanes == NULL || instance->slots == NULL || instance->slotTimestamps == NULL || instance->slotReady == NULL)
+	{
+		perror("Failed to allocate memory for lanes");
+		goto stop_lanes;
+	}
+
+	for (int slot = 0; slot < instance->slotCount; slot++)
+	{
+		if ((instance->slots[slot] = pool_get_reserved(instance->pool, instance->width * instance->height * 4)) == NULL)
+		{
+			puts("Failed to get buffer for slot!");
+			goto stop_lanes;
+		}
+	}
+
+	for (; lanes < instance->laneCount; lanes++)
+	{
+		instance->lanes[lanes].owner = instance;
+
+		if ((instance->lanes[lanes].decoder = decoder_init(data, size, instance->width, instance->height, 1, NULL, instance->pool)) == NULL)
+		{
+			puts("Failed to create lane decoder!");
+			goto stop_lanes;
+		}
+	}
+
+	pthread_mutex_lock(&instance->lock);
+
+	for (int lane = 0; lane < instance->laneCount; lane++)
+	{
+		if (scheduler_submit(instance->scheduler, 0, decode_lane, &instance->lanes[lane]))
+		{
+			puts("Failed to submit lane!");
+			pthread_mutex_unlock(&instance->lock);
+			goto stop_lanes;
+		}
+
+		instance->active++;
+	}
+
+	pthread_mutex_unlock(&instance->lock);
+	return false;
+
+stop_lanes:
+	stop_lanes(instance, lanes);
+	return true;
+}
+
+decoder *decoder_init(void *data, int size, int width, int height, int threads, scheduler *scheduler, pool *pool)
+{
+	decoder *instance;
+
+	if ((instance = calloc(1, sizeof(*instance))) == NULL)
+	{
+		perror("Failed to allocate memory for instance");
+		return NULL;
+	}
+
+	instance->pool = pool;
+	instance->scheduler = scheduler;
+
+	WebPData webpData = {
+		.bytes = data,
+		.size = size
+	};
+
+	if ((instance->demuxer = WebPDemux(&webpData)) == NULL)
+	{
+		puts("Failed to parse file!");
+		goto free_instance;
+	}
+
+	if (!WebPInitDecoderConfig(&instance->config))
+	{
+		puts("Failed to initialise decoder configuration!");
+		goto delete_demuxer;
+	}
+
+	instance->canvasWidth = WebPDemuxGetI(instance->demuxer, WEBP_FF_CANVAS_WIDTH);
+	instance->canvasHeight = WebPDemuxGetI(instance->demuxer, WEBP_FF_CANVAS_HEIGHT);
+	instance->frames = WebPDemuxGetI(instance->demuxer, WEBP_FF_FRAME_COUNT);
+
+	if ((instance->keys = calloc(instance->frames, sizeof(*instance->keys))) == NULL)
+	{
+		perror("Failed to allocate memory for key frames");
+		goto delete_demuxer;
+	}
+
+	if ((instance->segments = calloc(instance->frames, sizeof(*instance->segments))) == NULL)
+	{
+		perror("Failed to allocate memory for segments");
+		goto free_keys;
+	}
+
+	WebPIterator iterator;
+
+	if (WebPDemuxGetFrame(instance->demuxer, 1, &iterator))
+	{
+		bool previousKey = false;
+		bool previousFull = false;
+		bool previousDispose = false;
+
+		do
+		{
+			bool full = iterator.x_offset == 0 && iterator.y_offset == 0 && iterator.width == instance->canvasWidth && iterator.height == instance->canvasHeight;
+			bool opaque = !iterator.has_alpha || iterator.blend_method == WEBP_MUX_NO_BLEND;
+
+			// Key frames are determined the same way as WebPAnimDecoder so transparent pixels come out identically
+			bool key = iterator.frame_num == 1 || (opaque && full) || (previousDispose && (previousFull || previousKey));
+
+			// Every key frame starts a segment which can be decoded without any of the frames before it
+			if (key)
+			{
+				instance->segments[instance->segmentCount].first = iterator.frame_num - 1;
+				instance->segments[instance->segmentCount].timestamp = instance->duration;
+				instance->segmentCount++;
+			}
+
+			instance->keys[iterator.frame_num - 1] = key;
+			instance->duration += iterator.duration;
+
+			previousKey = key;
+			previousFull = full;
+			previousDispose = iterator.dispose_method == WEBP_MUX_DISPOSE_BACKGROUND;
+		} while (iterator.frame_num < instance->frames && WebPDemuxNextFrame(&iterator));
+
+		WebPDemuxReleaseIterator(&iterator);
+	}
+
+	// Only the region shown on the display is ever decoded
+	instance->width = width < instance->canvasWidth ? width : instance->canvasWidth;
+	instance->height = height < instance->canvasHeight ? height : instance->canvasHeight;
+
+	if (scheduler != NULL && threads > 1 && instance->segmentCount > 1)
+	{
+		if (start_lanes(instance, data, size, threads))
+		{
+			goto free_segments;
+		}
+
+		return instance;
+	}
+
+	if ((instance->canvas = pool_get_reserved(pool, instance->width * instance->height * 4)) == NULL)
+	{
+		puts("Failed to get buffer for canvas!");
+		goto free_segments;
+	}
+
+	if ((instance->scratch = pool_get_reserved(pool, (instance->width + 1) * (instance->height + 1) * 4)) == NULL)
+	{
+		puts("Failed to get buffer for scratch!");
+		goto release_canvas;
+	}
+
+	instance->config.output.colorspace = MODE_RGBA;
+	instance->config.output.is_external_memory = 1;
+
+	return instance;
+
+release_canvas:
+	pool_release(pool, instance->canvas);
+
+free_segments:
+	free(instance->segments);
+
+free_keys:
+	free(instance->keys);
+
+delete_demuxer:
+	WebPDemuxDelete(instance->demuxer);
+
+free_instance:
+	free(instance);
+	return NULL;
+}
+
+void decoder_get_buffers(int threads, int *canvases, int *scratches)
+{
+	// Decoding with lanes takes a ring of slots as well as the canvas and scratch of each lane
+	*canvases = threads > 1 ? threads * (SLOTS_PER_THREAD + 1) : 1;
+	*scratches = threads;
+}
+
+void decoder_get_info(decoder *instance, int *frames, int *duration, int *canvasWidth, int *canvasHeight)
+{
+	*frames = instance->frames;
+	*duration = instance->duration;
+	*canvasWidth = instance->canvasWidth;
+	*canvasHeight = instance->canvasHeight;
+}
+
+bool decoder_has_next(decoder *instance)
+{
+	return instance->index < instance->frames;
+}
+
+uint8_t *decoder_get_next(decoder *instance, int *timestamp)
+{
+	if (instance->lanes == NULL)
+	{
+		return decode(instance, timestamp, NULL, NULL);
+	}
+
+	pthread_mutex_lock(&instance->lock);
+
+	// Asking for the next frame hands the slot of the previous one back to the lanes, and any lane parked on it is
+	// submitted again
+	instance->consumed = instance->index;
+
+	for (int index = 0; index < instance->laneCount; index++)
+	{
+		decoder_lane *lane = &instance->lanes[index];
+
+		if (lane->parked && lane->frame < instance->consumed + instance->slotCount)
+		{
+			if (scheduler_submit(instance->scheduler, lane->frame - instance->consumed, decode_lane, lane))
+			{
+				puts("Failed to submit lane!");
+				pthread_mutex_unlock(&instance->lock);
+				return NULL;
+			}
+
+			lane->parked = false;
+			instance->active++;
+		}
+	}
+
+	int slot = instance->index % instance->slotCount;
+
+	while (!instance->slotReady[slot])
+	{
+		pthread_cond_wait(&instance->condition, &instance->lock);
+	}
+
+	instance->slotReady[slot] = false;
+	*timestamp = instance->slotTimestamps[slot];
+
+	pthread_mutex_unlock(&instance->lock);
+
+	instance->index++;
+	return *timestamp < 0 ? NULL : instance->slots[slot];
+}
+
+uint8_t *decoder_stream_next(decoder *instance, int *timestamp, decoder_ready_function ready, void *context)
+{
+	if (instance->lanes == NULL)
+	{
+		return decode(instance, timestamp, ready, context);
+	}
+
+	// Frames decoded by lanes are already complete by the time they are taken
+	uint8_t *canvas = decoder_get_next(instance, timestamp);
+
+	if (canvas != NULL)
+	{
+		ready(context, canvas, instance->height);
+	}
+
+	return canvas;
+}
+
+void decoder_destroy(decoder *instance)
+{
+	if (instance->lanes != NULL)
+	{
+		stop_lanes(instance, instance->laneCount);
+	}
+
+	pool_release(instance->pool, instance->scratch);
+	pool_release(instance->pool, instance->canvas);
+	WebPDemuxDelete(instance->demuxer);
+	free(instance->segments);
+	free(instance->keys);
+	free(instance);
+}
\ No newline at end of file
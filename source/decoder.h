@@ -0,0 +1,21 @@
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pool.h"
+#include "scheduler.h"
+
+typedef struct decoder decoder;
+typedef void (*decoder_ready_function)(void *context, uint8_t *canvas, int rows);
+
+decoder *decoder_init(void *data, int size, int width, int height, int threads, scheduler *scheduler, pool *pool);
+void decoder_get_buffers(int threads, int *canvases, int *scratches);
+void decoder_get_info(decoder *instance, int *frames, int *duration, int *canvasWidth, int *canvasHeight);
+bool decoder_has_next(decoder *instance);
+uint8_t *decoder_get_next(decoder *instance, int *timestamp);
+uint8_t *decoder_stream_next(decoder *instance, int *timestamp, decoder_ready_function ready, void *context);
+void decoder_destroy(decoder *instance);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,356 @@
+#include <stdatomic.h>
+#include <string.h>
+
+#include "frame.h"
+
+#define TILE_PIXELS 64
+
+typedef struct composition
+{
+	uint8_t *buffer;
+	uint8_t **sources;
+	int *weights;
+	int count;
+	int width;
+	int height;
+	int rows;
+	int mix;
+	frame_statistics *statistics;
+	atomic_bool changed;
+} composition;
+
+// Statistics are gathered from each tile while it is still in the cache into a tally kept for the whole call, and only
+// combined into frame statistics once at the end. Sums and maxima are kept for each of sixteen byte lanes, so each lane
+// always holds the same channel and the loops over them vectorise. Luminance uses the Rec. 709 weights and is only
+// binned for every sixteenth pixel, which is plenty to shape a histogram of this many bins.
+
+#define LANES 16
+#define HISTOGRAM_STEP 16
+
+typedef struct tally
+{
+	uint32_t sums[LANES];
+	uint8_t maxima[LANES];
+	uint32_t histogram[FRAME_BINS];
+} tally;
+
+// Tiles are padded with zeros up to their full size, which leaves both the sums and the maxima as they are
+
+static void measure(tally *tally, uint8_t *tile, int pixels)
+{
+	const uint8_t *restrict input = tile;
+	uint16_t sums[LANES] = {0};
+	uint8_t maxima[LANES];
+
+	memcpy(maxima, tally->maxima, LANES);
+
+	for (int block = 0; block < TILE_PIXELS * 4; block += LANES)
+	{
+		for (int lane = 0; lane < LANES; lane++)
+		{
+			sums[lane] += input[block + lane];
+		}
+	}
+
+	for (int block = 0; block < TILE_PIXELS * 4; block += LANES)
+	{
+		for (int lane = 0; lane < LANES; lane++)
+		{
+			maxima[lane] = input[block + lane] > maxima[lane] ? input[block + lane] : maxima[lane];
+		}
+	}
+
+	for (int lane = 0; lane < LANES; lane++)
+	{
+		tally->sums[lane] += sums[lane];
+	}
+
+	memcpy(tally->maxima, maxima, LANES);
+
+	for (int pixel = 0; pixel < pixels; pixel += HISTOGRAM_STEP)
+	{
+		uint8_t r = input[pixel * 4];
+		uint8_t g = input[pixel * 4 + 1];
+		uint8_t b = input[pixel * 4 + 2];
+
+		tally->histogram[(uint16_t)(r * 54 + g * 183 + b * 19) / (65536 / FRAME_BINS)] += HISTOGRAM_STEP;
+	}
+}
+
+static void add_tally(frame_statistics *statistics, tally *tally)
+{
+	for (int lane = 0; lane < LANES; lane++)
+	{
+		if (lane % 4 != 3)
+		{
+			statistics->sums[lane % 4] += tally->sums[lane];
+		}
+	}
+
+	for (int bin = 0; bin < FRAME_BINS; bin++)
+	{
+		statistics->histogram[bin] += tally->histogram[bin];
+	}
+
+	for (int lane = 0; lane < LANES; lane++)
+	{
+		if (lane % 4 != 3 && tally->maxima[lane] > statistics->maximum)
+		{
+			statistics->maximum = tally->maxima[lane];
+		}
+	}
+}
+
+// Arithmetic is done a tile at a time in source channel order so the byte loops can be vectorised, with a separate
+// pass reordering each tile into the BGR layout sent to the display.
+
+static bool store(uint8_t *buffer, uint8_t *tile, int pixels, int mix, tally *tally)
+{
+	uint8_t *restrict destination = buffer;
+	uint8_t *restrict input = tile;
+	uint8_t changed = 0;
+
+	if (mix > 0)
+	{
+		uint8_t previous[TILE_PIXELS * 4];
+		uint16_t oldFactor = mix;
+		uint16_t newFactor = MIX_MAXIMUM - mix;
+
+		for (int pixel = 0; pixel < pixels; pixel++)
+		{
+			previous[pixel * 4] = destination[pixel * 3 + 2];
+			previous[pixel * 4 + 1] = destination[pixel * 3 + 1];
+			previous[pixel * 4 + 2] = destination[pixel * 3];
+			previous[pixel * 4 + 3] = 0;
+		}
+
+		for (int index = 0; index < pixels * 4; index++)
+		{
+			input[index] = (uint16_t)(previous[index] * oldFactor + input[index] * newFactor) / MIX_MAXIMUM;
+		}
+	}
+
+	if (tally != NULL)
+	{
+		measure(tally, input, pixels);
+	}
+
+	for (int pixel = 0; pixel < pixels; pixel++)
+	{
+		changed |= (destination[pixel * 3] ^ input[pixel * 4 + 2]) | (destination[pixel * 3 + 1] ^ input[pixel * 4 + 1]) | (destination[pixel * 3 + 2] ^ input[pixel * 4]);
+
+		destination[pixel * 3] = input[pixel * 4 + 2];
+		destination[pixel * 3 + 1] = input[pixel * 4 + 1];
+		destination[pixel * 3 + 2] = input[pixel * 4];
+	}
+
+	return changed != 0;
+}
+
+bool frame_convert(uint8_t *buffer, uint8_t *source, int pixels, int mix, frame_statistics *statistics)
+{
+	bool changed = false;
+	tally tally;
+
+	memset(&tally, 0, sizeof(tally));
+
+	for (int start = 0; start < pixels; start += TILE_PIXELS)
+	{
+		uint8_t tile[TILE_PIXELS * 4];
+		int count = pixels - start < TILE_PIXELS ? pixels - start : TILE_PIXELS;
+
+		memcpy(tile, source + start * 4, count * 4);
+		memset(tile + count * 4, 0, (TILE_PIXELS - count) * 4);
+		changed |= store(buffer + start * 3, tile, count, mix, statistics == NULL ? NULL : &tally);
+	}
+
+	if (statistics != NULL)
+	{
+		add_tally(statistics, &tally);
+	}
+
+	return changed;
+}
+
+bool frame_blend(uint8_t *buffer, uint8_t **sources, int *weights, int count, int pixels, int mix, frame_statistics *statistics)
+{
+	bool changed = false;
+	tally tally;
+
+	memset(&tally, 0, sizeof(tally));
+
+	for (int start = 0; start < pixels; start += TILE_PIXELS)
+	{
+		uint16_t sum[TILE_PIXELS * 4];
+		uint8_t tile[TILE_PIXELS * 4];
+		int length = (pixels - start < TILE_PIXELS ? pixels - start : TILE_PIXELS) * 4;
+
+		const uint8_t *restrict first = sources[0] + start * 4;
+		uint16_t firstWeight = weights[0];
+
+		for (int index = 0; index < length; index++)
+		{
+			sum[index] = first[index] * firstWeight;
+		}
+
+		// Weights add up to the fade maximum so the sum of any number of sources fits in 16 bits
+		for (int source = 1; source < count; source++)
+		{
+			const uint8_t *restrict input = sources[source] + start * 4;
+			uint16_t weight = weights[source];
+
+			for (int index = 0; index < length; index++)
+			{
+				sum[index] += input[index] * weight;
+			}
+		}
+
+		for (int index = 0; index < length; index++)
+		{
+			tile[index] = sum[index] / FADE_MAXIMUM;
+		}
+
+		memset(tile + length, 0, TILE_PIXELS * 4 - length);
+
+		changed |= store(buffer + start * 3, tile, length / 4, mix, statistics == NULL ? NULL : &tally);
+	}
+
+	if (statistics != NULL)
+	{
+		add_tally(statistics, &tally);
+	}
+
+	return changed;
+}
+
+static void compose_stripe(void *context, int stripe)
+{
+	composition *composition = context;
+	int row = stripe * composition->rows;
+	int rows = composition->height - row < composition->rows ? composition->height - row : composition->rows;
+	int offset = row * composition->width;
+	uint8_t *sources[FRAME_SOURCES];
+
+	for (int source = 0; source < composition->count; source++)
+	{
+		sources[source] = composition->sources[source] + offset * 4;
+	}
+
+	frame_statistics *statistics = composition->statistics == NULL ? NULL : &composition->statistics[stripe];
+	bool changed;
+
+	// Weights always add up to the fade maximum, so a single source needs no blending
+	if (composition->count == 1)
+	{
+		changed = frame_convert(composition->buffer + offset * 3, sources[0], rows * composition->width, composition->mix, statistics);
+	}
+	else
+	{
+		changed = frame_blend(composition->buffer + offset * 3, sources, composition->weights, composition->count, rows * composition->width, composition->mix, statistics);
+	}
+
+	if (changed)
+	{
+		atomic_store(&composition->changed, true);
+	}
+}
+
+static int get_rows(int width)
+{
+	int rows = FRAME_STRIPE_SIZE / (width * 4);
+	return rows > 0 ? rows : 1;
+}
+
+int frame_get_stripes(int width, int height)
+{
+	return (height + get_rows(width) - 1) / get_rows(width);
+}
+
+bool frame_compose(workers *workers, uint8_t *buffer, uint8_t **sources, int *weights, int count, int width, int height, int mix, frame_statistics *statistics, void (*ready)(void *context, int row, int rows), void *context)
+{
+	int stripes = frame_get_stripes(width, height);
+	frame_statistics partial[statistics == NULL ? 1 : stripes];
+
+	composition composition = {
+		.buffer = buffer,
+		.sources = sources,
+		.weights = weights,
+		.count = count,
+		.width = width,
+		.height = height,
+		.rows = get_rows(width),
+		.mix = mix,
+		.statistics = statistics == NULL ? NULL : partial
+	};
+
+	// Each stripe gathers statistics of its own which are combined once every stripe is done
+	if (statistics != NULL)
+	{
+		memset(partial, 0, stripes * sizeof(*partial));
+	}
+
+	atomic_init(&composition.changed, false);
+	workers_start(workers, compose_stripe, &composition, stripes);
+
+	// Stripes are handed over in order as soon as each is ready while later stripes are still being composed
+	for (int stripe = 0; ready != NULL && stripe < stripes; stripe++)
+	{
+		int row = stripe * composition.rows;
+
+		workers_wait(workers, stripe);
+		ready(context, row, height - row < composition.rows ? height - row : composition.rows);
+	}
+
+	workers_finish(workers);
+
+	if (statistics != NULL)
+	{
+		memset(statistics, 0, sizeof(*statistics));
+
+		for (int stripe = 0; stripe < stripes; stripe++)
+		{
+			frame_merge_statistics(statistics, &partial[stripe]);
+		}
+	}
+
+	return atomic_load(&composition.changed);
+}
+
+void frame_merge_statistics(frame_statistics *destination, frame_statistics *source)
+{
+	for (int channel = 0; channel < 3; channel++)
+	{
+		destination->sums[channel] += source->sums[channel];
+	}
+
+	for (int bin = 0; bin < FRAME_BINS; bin++)
+	{
+		destination->histogram[bin] += source->histogram[bin];
+	}
+
+	if (source->maximum > destination->maximum)
+	{
+		destination->maximum = source->maximum;
+	}
+}
+
+// The brightness is lowered straight away when the average luminance at the current brightness would exceed the limit,
+// and recovers gradually so the display does not visibly pump with every change of content.
+
+int frame_limit_brightness(frame_statistics *statistics, int pixels, int brightness, int limit, int current)
+{
+	uint64_t luminance = (statistics->sums[0] * 54 + statistics->sums[1] * 183 + statistics->sums[2] * 19) / 256;
+	int target = brightness;
+
+	if (pixels > 0 && luminance * brightness > (uint64_t)limit * pixels * 255)
+	{
+		target = (uint64_t)limit * pixels * 255 / luminance;
+	}
+
+	if (target < current)
+	{
+		return target;
+	}
+
+	return (current * 7 + target + 7) / 8;
+}
\ No newline at end of file
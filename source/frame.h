@@ -0,0 +1,29 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "workers.h"
+
+#define MIX_MAXIMUM 100
+#define FADE_MAXIMUM 256
+#define FRAME_SOURCES 4
+#define FRAME_STRIPE_SIZE 32768
+#define FRAME_BINS 32
+
+typedef struct
+{
+	uint64_t sums[3];
+	uint32_t histogram[FRAME_BINS];
+	uint8_t maximum;
+} frame_statistics;
+
+bool frame_convert(uint8_t *buffer, uint8_t *source, int pixels, int mix, frame_statistics *statistics);
+bool frame_blend(uint8_t *buffer, uint8_t **sources, int *weights, int count, int pixels, int mix, frame_statistics *statistics);
+int frame_get_stripes(int width, int height);
+bool frame_compose(workers *workers, uint8_t *buffer, uint8_t **sources, int *weights, int count, int width, int height, int mix, frame_statistics *statistics, void (*ready)(void *context, int row, int rows), void *context);
+void frame_merge_statistics(frame_statistics *destination, frame_statistics *source);
+int frame_limit_brightness(frame_statistics *statistics, int pixels, int brightness, int limit, int current);
+
+#endif
\ No newline at end of file
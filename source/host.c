@@ -0,0 +1,418 @@
+#include <dlfcn.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host.h"
+
+#define CACHE_LINE 64
+#define CHANNEL_SIZE 4096
+#define HOST_SLOTS 2
+#define HOST_GRACE 1000
+
+typedef struct host_channel
+{
+	atomic_uint request;
+	atomic_uint response;
+	atomic_bool stopping;
+	int slot;
+	bool measured;
+	frame_statistics statistics;
+	long received;
+	long finished;
+} host_channel;
+
+_Static_assert(sizeof(host_channel) <= CHANNEL_SIZE, "Host channel must fit within its reserved space");
+
+struct host
+{
+	pid_t process;
+	host_channel *channel;
+	uint8_t *slots;
+	long length;
+	int stride;
+	int width;
+	int height;
+	int deadline;
+	int slot;
+	int ready;
+	unsigned int sequence;
+	bool statistics;
+	bool exited;
+	int frames;
+	int missed;
+	int returned;
+	long handoffs;
+	long handbacks;
+};
+
+// Timestamps are written by both processes, which read the same monotonic clock
+
+static long get_microseconds()
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000000 + time.tv_nsec / 1000;
+}
+
+// The channel lives in memory shared with the host process, so the futexes can't use the private operations
+
+static void wait_for(atomic_uint *address, unsigned int value, long timeout)
+{
+	struct timespec time = {
+		.tv_sec = timeout / 1000000,
+		.tv_nsec = timeout % 1000000 * 1000
+	};
+
+	syscall(SYS_futex, address, FUTEX_WAIT, value, timeout < 0 ? NULL : &time, NULL, 0);
+}
+
+static void wake(atomic_uint *address)
+{
+	syscall(SYS_futex, address, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// Runs in the host process, which loads the extension in place of the player and works on frames in the slot named
+// by each request. A single byte written to the ready pipe reports whether the extension loaded and whether it wants
+// statistics, and the pipe closing without it means the host failed to start.
+
+static void serve(host *instance, char *path, int ready)
+{
+	host_channel *channel = instance->channel;
+	void *extension = NULL;
+	void (*update)() = NULL;
+	void (*statistics)() = NULL;
+	int status = EXIT_FAILURE;
+
+	if (path != NULL)
+	{
+		if ((extension = dlopen(path, RTLD_NOW)) == NULL)
+		{
+			puts("Failed to load extension!");
+			goto exit;
+		}
+
+		bool (*init)() = dlsym(extension, "init");
+
+		if (init != NULL && init())
+		{
+			puts("Failed to initialise extension!");
+			goto destroy_extension;
+		}
+
+		if ((update = dlsym(extension, "update")) == NULL)
+		{
+			puts("Extension does not provide update function!");
+			goto destroy_extension;
+		}
+
+		statistics = dlsym(extension, "statistics");
+	}
+
+	uint8_t started = statistics != NULL ? 2 : 1;
+
+	if (write(ready, &started, 1) != 1)
+	{
+		goto destroy_extension;
+	}
+
+	close(ready);
+	ready = -1;
+
+	unsigned int served = 0;
+
+	while (true)
+	{
+		unsigned int request;
+
+		while ((request = atomic_load(&channel->request)) == served)
+		{
+			wait_for(&channel->request, served, -1);
+		}
+
+		if (atomic_load(&channel->stopping))
+		{
+			break;
+		}
+
+		channel->received = get_microseconds();
+
+		if (statistics != NULL && channel->measured)
+		{
+			frame_statistics *measured = &channel->statistics;
+			statistics(instance->width * instance->height, measured->sums, measured->histogram, FRAME_BINS, measured->maximum);
+		}
+
+		if (update != NULL)
+		{
+			update(instance->width, instance->height, instance->slots + channel->slot * instance->stride);
+		}
+
+		channel->finished = get_microseconds();
+		served = request;
+
+		atomic_store(&channel->response, served);
+		wake(&channel->response);
+	}
+
+	status = EXIT_SUCCESS;
+
+destroy_extension:
+	if (extension != NULL)
+	{
+		void (*destroy)() = dlsym(extension, "destroy");
+
+		if (destroy != NULL)
+		{
+			destroy();
+		}
+
+		dlclose(extension);
+	}
+
+exit:
+	if (ready >= 0)
+	{
+		close(ready);
+	}
+
+	fflush(stdout);
+	_exit(status);
+}
+
+// Must be called before any threads are started, as only the calling thread is carried into the host process. A host
+// without a path runs no extension and returns every frame untouched, which is enough to time the handoff itself. The
+// host loads the extension while the caller carries on, and host_wait must be called before any frames are handed over.
+
+host *host_init(char *path, int width, int height, int deadline)
+{
+	host *instance;
+
+	if ((instance = calloc(1, sizeof(*instance))) == NULL)
+	{
+		perror("Failed to allocate memory for instance");
+		return NULL;
+	}
+
+	instance->stride = (width * height * 3 + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+	instance->length = CHANNEL_SIZE + (long)instance->stride * HOST_SLOTS;
+	instance->width = width;
+	instance->height = height;
+	instance->deadline = deadline;
+
+	// Frames are composed straight into slots of the shared mapping, so the host works on them without a copy
+	void *mapping = mmap(NULL, instance->length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	if (mapping == MAP_FAILED)
+	{
+		perror("Failed to map shared memory");
+		goto free_instance;
+	}
+
+	instance->channel = mapping;
+	instance->slots = (uint8_t *)mapping + CHANNEL_SIZE;
+
+	atomic_init(&instance->channel->request, 0);
+	atomic_init(&instance->channel->response, 0);
+	atomic_init(&instance->channel->stopping, false);
+
+	int ready[2];
+
+	if (pipe(ready))
+	{
+		perror("Failed to create pipe");
+		goto unmap_memory;
+	}
+
+	// Output still buffered at the fork would otherwise be written again by the host when it exits
+	fflush(stdout);
+
+	pid_t parent = getpid();
+
+	if ((instance->process = fork()) < 0)
+	{
+		perror("Failed to create host process");
+		close(ready[0]);
+		close(ready[1]);
+		goto unmap_memory;
+	}
+
+	if (instance->process == 0)
+	{
+		close(ready[0]);
+
+		// The host never outlives the player, even when the player is killed
+		prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+		if (getppid() != parent)
+		{
+			_exit(EXIT_FAILURE);
+		}
+
+		serve(instance, path, ready[1]);
+	}
+
+	close(ready[1]);
+	instance->ready = ready[0];
+
+	return instance;
+
+unmap_memory:
+	munmap(mapping, instance->length);
+
+free_instance:
+	free(instance);
+	return NULL;
+}
+
+// Waits for the host to finish loading the extension. Returns true when it failed to, in which case the host must
+// still be destroyed.
+
+bool host_wait(host *instance)
+{
+	uint8_t started = 0;
+	bool failed = read(instance->ready, &started, 1) != 1;
+
+	close(instance->ready);
+	instance->ready = -1;
+
+	if (failed)
+	{
+		waitpid(instance->process, NULL, 0);
+		instance->exited = true;
+	}
+
+	instance->statistics = started == 2;
+	return failed;
+}
+
+bool host_has_statistics(host *instance)
+{
+	return instance->statistics;
+}
+
+uint8_t *host_get_buffer(host *instance)
+{
+	return instance->slots + instance->slot * instance->stride;
+}
+
+// Hands the frame in the current buffer to the extension and waits for it until the deadline. Returns false when the
+// deadline was missed, in which case the extension keeps the slot and the buffer moves on to the next slot, whose
+// contents must be drawn again. Frames arriving while the extension is still busy with a late frame are not handed
+// over at all, so a stalled or crashed extension costs a single deadline rather than one for every frame.
+
+bool host_update(host *instance, frame_statistics *statistics)
+{
+	host_channel *channel = instance->channel;
+	instance->frames++;
+
+	if (instance->exited || atomic_load(&channel->response) != instance->sequence)
+	{
+		instance->missed++;
+		return true;
+	}
+
+	channel->slot = instance->slot;
+	channel->measured = statistics != NULL;
+
+	if (statistics != NULL)
+	{
+		channel->statistics = *statistics;
+	}
+
+	long handed = get_microseconds();
+	long deadline = handed + instance->deadline * 1000L;
+	unsigned int sequence = ++instance->sequence;
+
+	atomic_store(&channel->request, sequence);
+	wake(&channel->request);
+
+	unsigned int response;
+
+	while ((response = atomic_load(&channel->response)) != sequence)
+	{
+		long remaining = deadline - get_microseconds();
+
+		if (remaining <= 0)
+		{
+			instance->missed++;
+			instance->slot = (instance->slot + 1) % HOST_SLOTS;
+
+			if (waitpid(instance->process, NULL, WNOHANG) == instance->process)
+			{
+				puts("Extension host exited!");
+				instance->exited = true;
+			}
+
+			return false;
+		}
+
+		wait_for(&channel->response, response, remaining);
+	}
+
+	instance->handoffs += channel->received - handed;
+	instance->handbacks += get_microseconds() - channel->finished;
+	instance->returned++;
+
+	return true;
+}
+
+// Reports the frames handled since the last call, and the average time taken to wake the host with a frame and to
+// resume after it finished with one, in microseconds
+
+void host_get_latency(host *instance, int *frames, int *missed, long *handoff, long *handback)
+{
+	*frames = instance->frames;
+	*missed = instance->missed;
+	*handoff = instance->returned > 0 ? instance->handoffs / instance->returned : 0;
+	*handback = instance->returned > 0 ? instance->handbacks / instance->returned : 0;
+
+	instance->frames = 0;
+	instance->missed = 0;
+	instance->returned = 0;
+	instance->handoffs = 0;
+	instance->handbacks = 0;
+}
+
+void host_destroy(host *instance)
+{
+	host_channel *channel = instance->channel;
+
+	// A host destroyed while still starting stops once it has loaded the extension
+	if (instance->ready >= 0)
+	{
+		close(instance->ready);
+	}
+
+	if (!instance->exited)
+	{
+		atomic_store(&channel->stopping, true);
+		atomic_fetch_add(&channel->request, 1);
+		wake(&channel->request);
+
+		// An extension still stuck on a frame is given a moment to finish before it is killed
+		for (int waited = 0; waitpid(instance->process, NULL, WNOHANG) == 0; waited++)
+		{
+			if (waited == HOST_GRACE)
+			{
+				kill(instance->process, SIGKILL);
+				waitpid(instance->process, NULL, 0);
+				break;
+			}
+
+			usleep(1000);
+		}
+	}
+
+	munmap(instance->channel, instance->length);
+	free(instance);
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "frame.h"
+
+typedef struct host host;
+
+host *host_init(char *path, int width, int height, int deadline);
+bool host_wait(host *instance);
+bool host_has_statistics(host *instance);
+uint8_t *host_get_buffer(host *instance);
+bool host_update(host *instance, frame_statistics *statistics);
+void host_get_latency(host *instance, int *frames, int *missed, long *handoff, long *handback);
+void host_destroy(host *instance);
+
+#endif
\ No newline at end of file
@@ -1,99 +1,193 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "loader.h"
+#include "timing.h"
 
 typedef struct loader_queue_item
 {
+	loader *loader;
 	char *path;
 	void *data;
 	int size;
+	bool claimed;
+	bool stale;
+	bool removed;
 } loader_queue_item;
 
 struct loader
 {
+	pool *pool;
+	scheduler *scheduler;
 	int length;
 	loader_queue_item *queue;
 	int head;
 	int tail;
+	int jobs;
 	bool destroyed;
 	pthread_mutex_t lock;
 	pthread_cond_t condition;
 	pthread_t thread;
 };
 
-static void *loader_process(void *parameter)
+static void *read_file(char *path, int *size, pool *pool)
 {
-	loader *instance = parameter;
-	pthread_mutex_lock(&instance->lock);
+	void *data = NULL;
+	FILE *file;
 
-	for (int index = 0;; index = (index + 1) % instance->length)
+	if ((file = fopen(path, "r")) == NULL)
 	{
-		while (instance->destroyed || index == instance->head)
-		{
-			if (instance->destroyed)
-			{
-				goto unlock_mutex;
-			}
+		perror("Failed to open file");
+		goto exit;
+	}
 
-			pthread_cond_wait(&instance->condition, &instance->lock);
-		}
+	fseek(file, 0, SEEK_END);
+	*size = ftell(file);
 
-		loader_queue_item item = instance->queue[index];
-		pthread_mutex_unlock(&instance->lock);
-		FILE *file;
+	if (*size == -1)
+	{
+		perror("Failed to get file size");
+		goto close_file;
+	}
 
-		if ((file = fopen(item.path, "r")) == NULL)
-		{
-			perror("Failed to open file");
-			goto update_item;
-		}
+	rewind(file);
 
-		fseek(file, 0, SEEK_END);
-		item.size = ftell(file);
+	if ((data = pool_get(pool, *size)) == NULL)
+	{
+		puts("Failed to get buffer for file contents!");
+		goto close_file;
+	}
 
-		if (item.size == -1)
-		{
-			perror("Failed to get file size");
-			goto close_file;
-		}
+	if (fread(data, 1, *size, file) != *size)
+	{
+		perror("Failed to read file");
+		pool_release(pool, data);
+		data = NULL;
+	}
+
+close_file:
+	fclose(file);
+
+exit:
+	if (data == NULL)
+	{
+		*size = 0;
+	}
 
-		rewind(file);
+	return data;
+}
+
+static void load_queued(void *context);
 
-		if ((item.data = malloc(item.size)) == NULL)
+// Called with the lock held. Files are read in the order they were queued, ahead of any frames due after they were
+// asked for.
+
+static void request_load(loader *instance, loader_queue_item *item)
+{
+	if (instance->scheduler != NULL)
+	{
+		if (scheduler_submit(instance->scheduler, get_time(), load_queued, item))
 		{
-			perror("Failed to allocate memory for file contents");
-			goto close_file;
+			puts("Failed to submit load job!");
 		}
-
-		if (fread(item.data, 1, item.size, file) != item.size)
+		else
 		{
-			perror("Failed to read file");
-			free(item.data);
+			instance->jobs++;
 		}
+	}
+
+	pthread_cond_broadcast(&instance->condition);
+}
+
+// Called with the lock held, which is released while the file is read. Whoever claims an item first reads it, so
+// loader_get can read a file itself rather than wait for a thread that may be busy with the caller.
+
+static void load_item(loader *instance, loader_queue_item *item)
+{
+	item->claimed = true;
+	char *path = item->path;
 
-	close_file:
-		fclose(file);
+	pthread_mutex_unlock(&instance->lock);
+
+	int size;
+	void *data = read_file(path, &size, instance->pool);
+
+	pthread_mutex_lock(&instance->lock);
+
+	// A file removed while it was being read is dropped, and one replaced while it was being read is read again
+	if (item->removed || item->stale)
+	{
+		pool_release(instance->pool, data);
+		data = NULL;
+		size = item->removed ? 0 : -1;
+	}
+
+	item->data = data;
+	item->size = size;
+
+	if (!item->removed && item->stale)
+	{
+		item->stale = false;
+		item->claimed = false;
+		request_load(instance, item);
+	}
+
+	pthread_cond_broadcast(&instance->condition);
+}
+
+static void *loader_process(void *parameter)
+{
+	loader *instance = parameter;
+	pthread_mutex_lock(&instance->lock);
+
+	while (!instance->destroyed)
+	{
+		loader_queue_item *item = NULL;
+
+		// Every pass starts from the front of the queue, so items reloaded in place are read again in turn
+		for (int index = instance->tail; item == NULL && index != instance->head; index = (index + 1) % instance->length)
+		{
+			if (!instance->queue[index].claimed)
+			{
+				item = &instance->queue[index];
+			}
+		}
 
-	update_item:
-		if (item.data == NULL || item.size < 0)
+		if (item == NULL)
 		{
-			item.data = NULL;
-			item.size = 0;
+			pthread_cond_wait(&instance->condition, &instance->lock);
+			continue;
 		}
 
-		pthread_mutex_lock(&instance->lock);
-		instance->queue[index] = item;
-		pthread_cond_broadcast(&instance->condition);
+		load_item(instance, item);
 	}
 
-unlock_mutex:
 	pthread_mutex_unlock(&instance->lock);
 	return NULL;
 }
 
-loader *loader_init(int length)
+static void load_queued(void *context)
+{
+	loader_queue_item *item = context;
+	loader *instance = item->loader;
+
+	pthread_mutex_lock(&instance->lock);
+
+	// The slot may already have been read, or even reused for a later file, by the time the job runs
+	if (!item->claimed)
+	{
+		load_item(instance, item);
+	}
+
+	instance->jobs--;
+	pthread_cond_broadcast(&instance->condition);
+
+	pthread_mutex_unlock(&instance->lock);
+}
+
+loader *loader_init(int length, pool *pool, scheduler *scheduler)
 {
 	loader *instance;
 
@@ -103,6 +197,8 @@ loader *loader_init(int length)
 		return NULL;
 	}
 
+	instance->pool = pool;
+	instance->scheduler = scheduler;
 	instance->length = ++length;
 
 	if ((instance->queue = calloc(length, sizeof(*instance->queue))) == NULL)
@@ -111,10 +207,16 @@ loader *loader_init(int length)
 		goto free_instance;
 	}
 
+	for (int index = 0; index < length; index++)
+	{
+		instance->queue[index].loader = instance;
+	}
+
 	pthread_mutex_init(&instance->lock, NULL);
 	pthread_cond_init(&instance->condition, NULL);
 
-	if (pthread_create(&instance->thread, NULL, loader_process, instance))
+	// Loaders sharing a scheduler read files as jobs on its threads rather than with a thread of their own
+	if (scheduler == NULL && pthread_create(&instance->thread, NULL, loader_process, instance))
 	{
 		puts("Failed to create processing thread!");
 		goto free_queue;
@@ -149,12 +251,21 @@ bool loader_add(loader *instance, char *path)
 
 	loader_queue_item *item = &instance->queue[instance->head];
 
-	item->path = path;
+	// The path is copied so the caller is free to release its own as soon as the file is removed from the queue
+	if ((item->path = strdup(path)) == NULL)
+	{
+		perror("Failed to allocate memory for path");
+		full = true;
+		goto unlock;
+	}
+
 	item->size = -1;
+	item->claimed = false;
+	item->stale = false;
+	item->removed = false;
 
 	instance->head = next;
-
-	pthread_cond_broadcast(&instance->condition);
+	request_load(instance, item);
 
 unlock:
 	pthread_mutex_unlock(&instance->lock);
@@ -166,29 +277,117 @@ void *loader_get(loader *instance, int *size)
 	pthread_mutex_lock(&instance->lock);
 
 	void *data = NULL;
+	loader_queue_item *item;
 
-	if (instance->head == instance->tail)
+	// Removed items keep their place until any read still in progress finishes, as the read fills in the item
+	do
 	{
-		puts("No files in queue!");
-		goto unlock;
-	}
+		if (instance->head == instance->tail)
+		{
+			puts("No files in queue!");
+			goto unlock;
+		}
 
-	loader_queue_item *item = &instance->queue[instance->tail];
+		item = &instance->queue[instance->tail];
 
-	while ((*size = item->size) < 0)
-	{
-		pthread_cond_wait(&instance->condition, &instance->lock);
+		while ((*size = item->size) < 0)
+		{
+			if (!item->claimed)
+			{
+				load_item(instance, item);
+				continue;
+			}
+
+			pthread_cond_wait(&instance->condition, &instance->lock);
+		}
+
+		instance->tail = (instance->tail + 1) % instance->length;
+
+		free(item->path);
+		item->path = NULL;
 	}
+	while (item->removed);
 
 	data = item->data;
 
-	instance->tail = (instance->tail + 1) % instance->length;
-
 unlock:
 	pthread_mutex_unlock(&instance->lock);
 	return data;
 }
 
+// Drops every queued item for the path given, returning how many were dropped. Items still being read are dropped once
+// the read finishes.
+
+int loader_remove(loader *instance, char *path)
+{
+	pthread_mutex_lock(&instance->lock);
+
+	int removed = 0;
+
+	for (int index = instance->tail; index != instance->head; index = (index + 1) % instance->length)
+	{
+		loader_queue_item *item = &instance->queue[index];
+
+		if (item->removed || strcmp(item->path, path) != 0)
+		{
+			continue;
+		}
+
+		item->removed = true;
+		removed++;
+
+		if (!item->claimed)
+		{
+			item->claimed = true;
+			item->data = NULL;
+			item->size = 0;
+		}
+		else if (item->size >= 0)
+		{
+			pool_release(instance->pool, item->data);
+			item->data = NULL;
+		}
+	}
+
+	pthread_cond_broadcast(&instance->condition);
+	pthread_mutex_unlock(&instance->lock);
+
+	return removed;
+}
+
+// Reads every queued item for the path given again, as the file has been replaced since it was read
+
+void loader_reload(loader *instance, char *path)
+{
+	pthread_mutex_lock(&instance->lock);
+
+	for (int index = instance->tail; index != instance->head; index = (index + 1) % instance->length)
+	{
+		loader_queue_item *item = &instance->queue[index];
+
+		if (item->removed || !item->claimed || strcmp(item->path, path) != 0)
+		{
+			continue;
+		}
+
+		if (item->size < 0)
+		{
+			item->stale = true;
+			continue;
+		}
+
+		pool_release(instance->pool, item->data);
+
+		item->data = NULL;
+		item->size = -1;
+		item->claimed = false;
+
+		request_load(instance, item);
+	}
+
+	pthread_mutex_unlock(&instance->lock);
+}
+
 void loader_destroy(loader *instance)
 {
 	pthread_mutex_lock(&instance->lock);
@@ -196,9 +395,18 @@ void loader_destroy(loader *instance)
 	instance->destroyed = true;
 	pthread_cond_broadcast(&instance->condition);
 
+	// Jobs still queued on a shared scheduler refer to this instance until they have run
+	while (instance->jobs > 0)
+	{
+		pthread_cond_wait(&instance->condition, &instance->lock);
+	}
+
 	pthread_mutex_unlock(&instance->lock);
 
-	pthread_join(instance->thread, NULL);
+	if (instance->scheduler == NULL)
+	{
+		pthread_join(instance->thread, NULL);
+	}
 
 	pthread_cond_destroy(&instance->condition);
 	pthread_mutex_destroy(&instance->lock);
@@ -209,9 +417,10 @@ void loader_destroy(loader *instance)
 
 		if (item.size >= 0)
 		{
-			free(instance->queue[instance->tail].data);
+			pool_release(instance->pool, item.data);
 		}
 
+		free(item.path);
 		instance->tail = (instance->tail + 1) % instance->length;
 	}
 
@@ -3,11 +3,18 @@
 
 #include <stdbool.h>
 
+#include "pool.h"
+#include "scheduler.h"
+
+#define QUEUE_SIZE 4
+
 typedef struct loader loader;
 
-loader *loader_init(int length);
+loader *loader_init(int length, pool *pool, scheduler *scheduler);
 bool loader_add(loader *instance, char *path);
 void *loader_get(loader *instance, int *size);
+int loader_remove(loader *instance, char *path);
+void loader_reload(loader *instance, char *path);
 void loader_destroy(loader *instance);
 
 #endif
\ No newline at end of file
@@ -1,19 +1,89 @@
 #include <dlfcn.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
-#include <unistd.h>
-
-#include <webp/demux.h>
 
 #include "colorlight.h"
+#include "compositor.h"
+#include "frame.h"
+#include "host.h"
 #include "loader.h"
+#include "playlist.h"
+#include "pool.h"
+#include "scheduler.h"
+#include "synchronizer.h"
+#include "timing.h"
+#include "track.h"
+#include "workers.h"
+#include "zone.h"
+
+#define DECODERS 2
+#define TIMELINE_LENGTH 16
+#define FIRST_PIXELS_TARGET 100
+
+typedef struct
+{
+	long origin;
+	long shown;
+	atomic_int length;
+	long times[TIMELINE_LENGTH];
+	char *events[TIMELINE_LENGTH];
+} timeline;
+
+// Records how long after launch each step of startup finished, up to the first frame being shown. Steps done at the same
+// time on different threads each take a place of their own.
+
+void mark(timeline *timeline, char *event)
+{
+	int index = atomic_fetch_add(&timeline->length, 1);
+
+	if (index < TIMELINE_LENGTH)
+	{
+		timeline->times[index] = get_precise_time() - timeline->origin;
+		timeline->events[index] = event;
+	}
+}
+
+// The first time anything reaches the display is kept apart from the other steps to compare against the target
+
+void show(timeline *timeline, char *event)
+{
+	mark(timeline, event);
+
+	if (timeline->shown == 0)
+	{
+		timeline->shown = get_precise_time() - timeline->origin;
+	}
+}
 
-#define QUEUE_SIZE 4
-#define MIX_MAXIMUM 100
-#define UPDATE_DELAY 10
+void print_timeline(timeline *timeline)
+{
+	puts("Startup timeline in milliseconds since launch:");
+
+	int length = atomic_load(&timeline->length);
+
+	for (int index = 0; index < length && index < TIMELINE_LENGTH; index++)
+	{
+		printf("%8.2f  %s\n", timeline->times[index] / 1000.0, timeline->events[index]);
+	}
+
+	printf("First pixels shown after %.2f ms, %s the %d ms target.\n", timeline->shown / 1000.0, timeline->shown <= FIRST_PIXELS_TARGET * 1000L ? "within" : "missing", FIRST_PIXELS_TARGET);
+}
+
+typedef struct
+{
+	int x;
+	int y;
+	int width;
+	int height;
+	int start;
+} area;
 
 bool parse(const char *source, int *destination)
 {
@@ -22,360 +92,1706 @@ bool parse(const char *source, int *destination)
 	return end[0] != 0;
 }
 
-long get_time()
+bool parse_area(const char *source, area *destination)
 {
-	struct timespec time;
-	clock_gettime(CLOCK_MONOTONIC, &time);
-	return time.tv_sec * 1000 + time.tv_nsec / 1000000;
+	int length = 0;
+	sscanf(source, "%d,%d,%d,%d%n", &destination->x, &destination->y, &destination->width, &destination->height, &length);
+	return length == 0 || source[length] != 0;
 }
 
-void await(long time)
+typedef struct
+{
+	char *port;
+	int width;
+	int height;
+	int brightness;
+	int limit;
+	int mix;
+	int rate;
+	bool shuffle;
+	char **sources;
+	int sourcesLength;
+	area *areas;
+	int areasLength;
+	host *host;
+	colorlight *colorlight;
+	compositor *compositor;
+	bool finished;
+} display;
+
+bool check_areas(area *areas, int areasLength, int sourcesLength, int width, int height)
 {
-	long delay = time - get_time();
+	if (areasLength > 0 && areas[0].width == 0)
+	{
+		areas[0].width = width;
+		areas[0].height = height;
+	}
 
-	if (delay > 0)
+	for (int index = 0; index < areasLength; index++)
 	{
-		usleep(delay * 1000);
+		area *area = &areas[index];
+
+		if (area->x < 0 || area->y < 0 || area->width < 1 || area->height < 1 || area->x + area->width > width || area->y + area->height > height)
+		{
+			puts("Zones must fit within the display!");
+			return true;
+		}
+
+		if ((index + 1 < areasLength ? areas[index + 1].start : sourcesLength) == area->start)
+		{
+			puts("Every zone must have at least one source!");
+			return true;
+		}
 	}
+
+	return false;
 }
 
-int main(int argc, char *argv[])
+// Each line of a displays file describes one display with the same options used on the command line. Options not given
+// on a line take the values given on the command line.
+
+bool parse_display(char *line, display *display)
 {
-	int status = EXIT_FAILURE;
-	char *port = NULL;
-	int width = 0;
-	int height = 0;
-	int brightness = 255;
-	int mix = 0;
-	int rate = 0;
-	char *extensionFile = NULL;
-	bool shuffle = false;
-	bool verbose = false;
-	int sourcesLength = 0;
-	char **sources;
+	int length = 0;
+	char *tokens[strlen(line) / 2 + 1];
+	char *position;
 
-	srand(time(NULL));
+	for (char *token = strtok_r(line, " \t\r", &position); token != NULL; token = strtok_r(NULL, " \t\r", &position))
+	{
+		tokens[length++] = token;
+	}
 
-	if ((sources = malloc((argc - 1) * sizeof(*sources))) == NULL)
+	if ((display->sources = malloc(length * sizeof(*display->sources))) == NULL)
 	{
 		perror("Failed to allocate memory for sources");
-		goto exit;
+		return true;
 	}
 
-	for (int index = 1; index < argc; index++)
+	if ((display->areas = calloc(length + 1, sizeof(*display->areas))) == NULL)
 	{
-		char *argument = argv[index];
+		perror("Failed to allocate memory for zones");
+		return true;
+	}
 
-		if (argument[0] != '-')
+	for (int index = 0; index < length; index++)
+	{
+		char *token = tokens[index];
+
+		if (token[0] != '-')
 		{
-			sources[sourcesLength++] = argument;
+			if (playlist_is_folder(token))
+			{
+				puts("Folders can't be used with displays!");
+				return true;
+			}
+
+			display->sources[display->sourcesLength++] = token;
 			continue;
 		}
 
 		bool failed = false;
 
-		switch (argument[1])
+		switch (token[1])
 		{
 			case 'p':
-				failed = ++index >= argc;
-				port = argv[index];
+				failed = ++index >= length;
+				display->port = tokens[index];
 				break;
 
 			case 'w':
-				failed = ++index >= argc || parse(argv[index], &width);
+				failed = ++index >= length || parse(tokens[index], &display->width);
 				break;
 
 			case 'h':
-				failed = ++index >= argc || parse(argv[index], &height);
+				failed = ++index >= length || parse(tokens[index], &display->height);
 				break;
 
 			case 'b':
-				failed = ++index >= argc || parse(argv[index], &brightness);
+				failed = ++index >= length || parse(tokens[index], &display->brightness);
 				break;
 
-			case 'm':
-				failed = ++index >= argc || parse(argv[index], &mix);
+			case 'i':
+				failed = ++index >= length || parse(tokens[index], &display->limit);
 				break;
 
-			case 'r':
-				failed = ++index >= argc || parse(argv[index], &rate);
+			case 'm':
+				failed = ++index >= length || parse(tokens[index], &display->mix);
 				break;
 
-			case 'e':
-				failed = ++index >= argc;
-				extensionFile = argv[index];
+			case 'r':
+				failed = ++index >= length || parse(tokens[index], &display->rate);
 				break;
 
 			case 's':
-				shuffle = true;
+				display->shuffle = true;
 				break;
 
-			case 'v':
-				verbose = true;
+			case 'z':
+				if (display->areasLength == 0 && display->sourcesLength > 0)
+				{
+					display->areasLength++;
+				}
+
+				failed = ++index >= length || parse_area(tokens[index], &display->areas[display->areasLength]);
+				display->areas[display->areasLength++].start = display->sourcesLength;
 				break;
 
 			default:
 				failed = true;
 		}
 
-		if (failed || argument[2] != 0)
+		if (failed || token[2] != 0)
 		{
-			puts("Usage:");
-			puts("  panelplayer -p <port> -w <width> -h <height> [options] <sources>");
-			puts("");
-			puts("Options:");
-			puts("  -p <port>       Set ethernet port");
-			puts("  -w <width>      Set display width");
-			puts("  -h <height>     Set display height");
-			puts("  -b <brightness> Set display brightness");
-			puts("  -m <mix>        Set frame mixing percentage");
-			puts("  -r <rate>       Override source frame rate");
-			puts("  -e <extension>  Load extension from file");
-			puts("  -s              Shuffle sources");
-			puts("  -v              Enable verbose output");
-
-			goto free_sources;
+			printf("Invalid option %s for display!\n", token);
+			return true;
 		}
 	}
 
-	if (port == NULL)
+	// A display without zones plays its sources in a single zone covering the whole display
+	if (display->areasLength == 0)
 	{
-		puts("Port must be specified!");
-		goto free_sources;
+		display->areasLength++;
+	}
+
+	if (display->port == NULL)
+	{
+		puts("Every display must have a port!");
+		return true;
 	}
 
-	if (width < 1 || height < 1)
+	if (display->width < 1 || display->height < 1)
 	{
 		puts("Width and height must be specified as positive integers!");
-		goto free_sources;
+		return true;
 	}
 
-	if (brightness < 0 || brightness > 255)
+	if (display->brightness < 0 || display->brightness > 255)
 	{
 		puts("Brightness must be an integer between 0 and 255!");
-		goto free_sources;
+		return true;
 	}
 
-	if (mix < 0 || mix >= MIX_MAXIMUM)
+	if (display->limit < 0 || display->limit > 255)
+	{
+		puts("Luminance limit must be an integer between 0 and 255!");
+		return true;
+	}
+
+	if (display->mix < 0 || display->mix >= MIX_MAXIMUM)
 	{
 		printf("Mix must be an integer between 0 and %d!\n", MIX_MAXIMUM - 1);
-		goto free_sources;
+		return true;
 	}
 
-	if (sourcesLength == 0)
+	if (display->sourcesLength == 0)
 	{
 		puts("At least one source must be specified!");
-		goto free_sources;
+		return true;
 	}
 
-	uint8_t *buffer;
+	return check_areas(display->areas, display->areasLength, display->sourcesLength, display->width, display->height);
+}
 
-	if ((buffer = malloc(width * height * 3)) == NULL)
+void free_displays(display *displays, int displaysLength)
+{
+	for (int index = 0; index < displaysLength; index++)
 	{
-		perror("Failed to allocate frame buffer");
-		goto free_sources;
+		free(displays[index].areas);
+		free(displays[index].sources);
 	}
 
-	loader *loader;
+	free(displays);
+}
 
-	if ((loader = loader_init(QUEUE_SIZE)) == NULL)
+display *read_displays(char *path, char **text, int *displaysLength, display *defaults)
+{
+	display *displays = NULL;
+	FILE *file;
+
+	if ((file = fopen(path, "r")) == NULL)
 	{
-		puts("Failed to create loader instance!");
-		goto free_buffer;
+		perror("Failed to open displays file");
+		return NULL;
 	}
 
-	colorlight *colorlight;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	rewind(file);
 
-	if ((colorlight = colorlight_init(port)) == NULL)
+	if (size == -1)
 	{
-		puts("Failed to create Colorlight instance!");
-		goto destroy_loader;
+		perror("Failed to get displays file size");
+		goto close_file;
 	}
 
-	void *extension = NULL;
-	void (*update)() = NULL;
+	// Sources point into the text of the file, which is kept for as long as the displays are
+	if ((*text = malloc(size + 1)) == NULL)
+	{
+		perror("Failed to allocate memory for displays file");
+		goto close_file;
+	}
 
-	if (extensionFile != NULL)
+	if (fread(*text, 1, size, file) != size)
 	{
-		extension = dlopen(extensionFile, RTLD_NOW);
+		perror("Failed to read displays file");
+		goto free_text;
+	}
 
-		if (extension == NULL)
-		{
-			puts("Failed to load extension!");
-			goto destroy_colorlight;
-		}
+	(*text)[size] = 0;
+
+	if ((displays = calloc(size / 2 + 1, sizeof(*displays))) == NULL)
+	{
+		perror("Failed to allocate memory for displays");
+		goto free_text;
+	}
 
-		bool (*init)() = dlsym(extension, "init");
+	*displaysLength = 0;
+	char *position;
 
-		if (init != NULL)
+	for (char *line = strtok_r(*text, "\n", &position); line != NULL; line = strtok_r(NULL, "\n", &position))
+	{
+		line += strspn(line, " \t\r");
+
+		if (line[0] == 0 || line[0] == '#')
 		{
-			if (init())
-			{
-				puts("Failed to initialise extension!");
-				goto destroy_extension;
-			}
+			continue;
 		}
 
-		update = dlsym(extension, "update");
+		display *display = &displays[(*displaysLength)++];
+
+		display->brightness = defaults->brightness;
+		display->limit = defaults->limit;
+		display->mix = defaults->mix;
+		display->rate = defaults->rate;
+		display->shuffle = defaults->shuffle;
 
-		if (update == NULL)
+		if (parse_display(line, display))
 		{
-			puts("Extension does not provide update function!");
-			goto destroy_extension;
+			printf("Failed to parse display %d!\n", *displaysLength);
+			goto free_displays;
 		}
 	}
 
-	int queued = 0;
-	long next = get_time();
-	bool initial = true;
-
-	for (int source = 0; shuffle || source < sourcesLength; source++)
+	if (*displaysLength == 0)
 	{
-		while (queued < source + QUEUE_SIZE)
-		{
-			if (shuffle)
-			{
-				loader_add(loader, sources[rand() % sourcesLength]);
-			}
-			else if (queued < sourcesLength)
-			{
-				loader_add(loader, sources[queued]);
-			}
+		puts("At least one display must be specified!");
+		goto free_displays;
+	}
 
-			queued++;
-		}
+	goto close_file;
 
-		int size;
-		void *file;
+free_displays:
+	free_displays(displays, *displaysLength);
+	displays = NULL;
 
-		if ((file = loader_get(loader, &size)) == NULL)
-		{
-			continue;
-		}
+free_text:
+	free(*text);
 
-		WebPData data = {
-			.bytes = file,
-			.size = size
-		};
+close_file:
+	fclose(file);
+	return displays;
+}
+
+// Every display has its own compositor and port, while decoding and loading for all of them share one scheduler.
+// Displays take turns at the time of their next event, so a display waiting on a late frame never holds up the others.
+
+bool play_displays(display *displays, int displaysLength, int threads, bool xdp, void (*update)(), void (*statistics)(), pool *pool, bool verbose)
+{
+	bool failed = true;
+	scheduler *scheduler;
+
+	if ((scheduler = scheduler_init(threads)) == NULL)
+	{
+		puts("Failed to create scheduler instance!");
+		return true;
+	}
 
-		WebPAnimDecoder *decoder;
+	long start = get_time();
+	int opened = 0;
 
-		if ((decoder = WebPAnimDecoderNew(&data, NULL)) == NULL)
+	while (opened < displaysLength)
+	{
+		display *display = &displays[opened];
+
+		if ((display->colorlight = colorlight_init(display->port, xdp)) == NULL)
 		{
-			puts("Failed to decode file!");
-			goto free_file;
+			puts("Failed to create Colorlight instance!");
+			goto destroy_displays;
 		}
 
-		WebPAnimInfo info;
-		WebPAnimDecoderGetInfo(decoder, &info);
-
-		if (verbose)
+		if (verbose && colorlight_has_xdp(display->colorlight))
 		{
-			printf("Decoding %d frames at a resolution of %dx%d.\n", info.frame_count, info.canvas_width, info.canvas_height);
+			printf("Sending packets on %s with AF_XDP.\n", display->port);
 		}
 
-		if (info.canvas_width < width || info.canvas_height < height)
+		if ((display->compositor = compositor_init(display->colorlight, scheduler, display->port, display->width, display->height, display->brightness, display->limit, display->mix, update, statistics, display->host, pool, verbose)) == NULL)
 		{
-			puts("Image is smaller than display!");
-			goto delete_decoder;
+			puts("Failed to create compositor instance!");
+			colorlight_destroy(display->colorlight);
+			goto destroy_displays;
 		}
 
-		int previous = 0;
-		long start = next;
+		opened++;
 
-		while (WebPAnimDecoderHasMoreFrames(decoder))
+		for (int index = 0; index < display->areasLength; index++)
 		{
-			uint8_t *decoded;
-			int timestamp;
-
-			WebPAnimDecoderGetNext(decoder, &decoded, &timestamp);
+			area *area = &display->areas[index];
+			int length = (index + 1 < display->areasLength ? display->areas[index + 1].start : display->sourcesLength) - area->start;
+			zone *zone;
 
-			for (int y = 0; y < height; y++)
+			if ((zone = zone_init(display->sources + area->start, length, area->x, area->y, area->width, area->height, display->rate, display->shuffle, index > 0, start, scheduler, pool, verbose)) == NULL)
 			{
-				for (int x = 0; x < width; x++)
-				{
-					int source = (y * info.canvas_width + x) * 4;
-					int destination = (y * width + x) * 3;
-
-					int oldFactor = initial ? 0 : mix;
-					int newFactor = MIX_MAXIMUM - oldFactor;
-
-					buffer[destination] = (buffer[destination] * oldFactor + decoded[source + 2] * newFactor) / MIX_MAXIMUM;
-					buffer[destination + 1] = (buffer[destination + 1] * oldFactor + decoded[source + 1] * newFactor) / MIX_MAXIMUM;
-					buffer[destination + 2] = (buffer[destination + 2] * oldFactor + decoded[source] * newFactor) / MIX_MAXIMUM;
-				}
+				puts("Failed to create zone instance!");
+				goto destroy_displays;
 			}
 
-			if (update != NULL)
+			if (compositor_add_zone(display->compositor, zone))
 			{
-				update(width, height, buffer);
+				zone_destroy(zone);
+				goto destroy_displays;
 			}
+		}
+	}
 
-			for (int y = 0; y < height; y++)
-			{
-				colorlight_send_row(colorlight, y, width, buffer + y * width * 3);
-			}
+	for (int index = 0; index < displaysLength; index++)
+	{
+		compositor_start(displays[index].compositor);
+	}
 
-			if (next - get_time() < UPDATE_DELAY)
+	for (int running = displaysLength; running > 0;)
+	{
+		display *next = NULL;
+		long event = LONG_MAX;
+
+		for (int index = 0; index < displaysLength; index++)
+		{
+			if (displays[index].finished)
 			{
-				next = get_time() + UPDATE_DELAY;
+				continue;
 			}
 
-			await(next);
-			colorlight_send_update(colorlight, brightness, brightness, brightness);
+			long time = compositor_get_event(displays[index].compositor);
 
-			if (rate > 0)
-			{
-				next = get_time() + 1000 / rate;
-			}
-			else
+			if (next == NULL || time < event)
 			{
-				next = get_time() + timestamp - previous;
-				previous = timestamp;
+				next = &displays[index];
+				event = time;
 			}
-
-			initial = false;
 		}
 
-		if (verbose)
+		await(event);
+
+		if (!compositor_step(next->compositor))
 		{
-			float seconds = (next - start) / 1000.0;
-			printf("Played %d frames in %.2f seconds at an average rate of %.2f frames per second.\n", info.frame_count, seconds, info.frame_count / seconds);
+			next->finished = true;
+			running--;
 		}
+	}
 
-	delete_decoder:
-		WebPAnimDecoderDelete(decoder);
+	failed = false;
 
-	free_file:
-		free(file);
+destroy_displays:
+	while (opened > 0)
+	{
+		display *display = &displays[--opened];
+
+		compositor_destroy(display->compositor);
+		colorlight_destroy(display->colorlight);
 	}
 
-	await(next);
-	status = EXIT_SUCCESS;
+	scheduler_destroy(scheduler);
+	return failed;
+}
 
-destroy_extension:
-	if (extension != NULL)
+// The destroy function is called even when the init function failed
+
+void close_extension(void *extension)
+{
+	void (*destroy)() = dlsym(extension, "destroy");
+
+	if (destroy != NULL)
+	{
+		destroy();
+	}
+
+	dlclose(extension);
+}
+
+void *open_extension(char *path, void (**update)(), void (**statistics)())
+{
+	void *extension;
+
+	if ((extension = dlopen(path, RTLD_NOW)) == NULL)
+	{
+		puts("Failed to load extension!");
+		return NULL;
+	}
+
+	bool (*init)() = dlsym(extension, "init");
+
+	if (init != NULL && init())
+	{
+		puts("Failed to initialise extension!");
+		goto close_extension;
+	}
+
+	if ((*update = dlsym(extension, "update")) == NULL)
 	{
-		void (*destroy)() = dlsym(extension, "destroy");
+		puts("Extension does not provide update function!");
+		goto close_extension;
+	}
+
+	*statistics = dlsym(extension, "statistics");
+	return extension;
+
+close_extension:
+	close_extension(extension);
+	return NULL;
+}
+
+typedef struct
+{
+	char *port;
+	bool xdp;
+	char *extensionFile;
+	timeline *timeline;
+	colorlight *colorlight;
+	void *extension;
+	void (*update)();
+	void (*statistics)();
+} setup;
+
+// Opening the ethernet port and loading an extension in process are left to a thread of their own, so they overlap with
+// starting the workers and reserving decoder buffers. The port is closed again when the extension fails to load.
 
-		if (destroy != NULL)
+void *set_up(void *context)
+{
+	setup *setup = context;
+
+	if ((setup->colorlight = colorlight_init(setup->port, setup->xdp)) == NULL)
+	{
+		puts("Failed to create Colorlight instance!");
+		return NULL;
+	}
+
+	mark(setup->timeline, "Opened ethernet port");
+
+	if (setup->extensionFile != NULL)
+	{
+		if ((setup->extension = open_extension(setup->extensionFile, &setup->update, &setup->statistics)) == NULL)
 		{
-			destroy();
+			colorlight_destroy(setup->colorlight);
+			setup->colorlight = NULL;
+			return NULL;
 		}
 
-		dlclose(extension);
+		mark(setup->timeline, "Loaded extension");
 	}
 
-destroy_colorlight:
-	colorlight_destroy(colorlight);
+	return NULL;
+}
 
-destroy_loader:
-	loader_destroy(loader);
+track *open_source(void *file, int size, int width, int height, int rate, bool interpolate, int threads, scheduler *scheduler, pool *pool, bool verbose)
+{
+	track *track;
+
+	if ((track = track_init(file, size, width, height, rate, interpolate, threads, scheduler, pool)) == NULL)
+	{
+		puts("Failed to decode file!");
+		pool_release(pool, file);
+		return NULL;
+	}
+
+	int frames;
+	int duration;
+	int canvasWidth;
+	int canvasHeight;
+
+	track_get_info(track, &frames, &duration, &canvasWidth, &canvasHeight);
+
+	if (verbose)
+	{
+		printf("Decoding %d frames at a resolution of %dx%d.\n", frames, canvasWidth, canvasHeight);
+	}
+
+	if (canvasWidth < width || canvasHeight < height)
+	{
+		puts("Image is smaller than display!");
+		track_destroy(track);
+		return NULL;
+	}
+
+	return track;
+}
+
+typedef struct
+{
+	colorlight *colorlight;
+	int width;
+	uint8_t *buffer;
+} transmission;
+
+void send_rows(void *context, int row, int rows)
+{
+	transmission *transmission = context;
+
+	for (int y = row; y < row + rows; y++)
+	{
+		colorlight_send_row(transmission->colorlight, y, transmission->width, transmission->buffer + y * transmission->width * 3);
+	}
+}
+
+typedef struct
+{
+	transmission *transmission;
+	int mix;
+	frame_statistics *statistics;
+	int rows;
+	bool changed;
+	bool send;
+	bool progressive;
+	int level;
+	int sentRows;
+	long sent;
+	timeline *timeline;
+} streaming;
+
+void stream_rows(void *context, uint8_t *canvas, int rows)
+{
+	streaming *streaming = context;
+	transmission *transmission = streaming->transmission;
+	int row = streaming->rows;
+
+	if (rows <= row)
+	{
+		return;
+	}
+
+	streaming->changed |= frame_convert(transmission->buffer + row * transmission->width * 3, canvas + row * transmission->width * 4, (rows - row) * transmission->width, streaming->mix, streaming->statistics);
+
+	// A progressive frame is shown as it is decoded, so a dark display lights up before the whole frame is ready. Rows
+	// are sent at most once per update delay, each time after showing the rows sent the time before, so the display
+	// always has the same time to take in rows as between whole frames.
+	if (streaming->progressive)
+	{
+		if (get_precise_time() - streaming->sent >= UPDATE_DELAY * 1000L)
+		{
+			if (streaming->sentRows > 0)
+			{
+				colorlight_send_update(transmission->colorlight, streaming->level, streaming->level, streaming->level);
+
+				if (streaming->timeline->shown == 0)
+				{
+					show(streaming->timeline, "Showed first rows");
+				}
+			}
+
+			send_rows(transmission, streaming->sentRows, rows - streaming->sentRows);
+			streaming->sentRows = rows;
+			streaming->sent = get_precise_time();
+		}
+	}
+	else if (streaming->send)
+	{
+		send_rows(transmission, row, rows - row);
+	}
+
+	streaming->rows = rows;
+}
+
+// Frames mixed with the last one shown are drawn again on top of a copy of it. Statistics are gathered again too, and come
+// out the same as for the frame the extension kept, as that was mixed with the same frame.
+
+void retry_frame(workers *workers, uint8_t *buffer, uint8_t *shown, uint8_t **sources, int *weights, int count, int width, int height, int mix, frame_statistics *statistics)
+{
+	if (shown != NULL && mix > 0)
+	{
+		memcpy(buffer, shown, width * height * 3);
+	}
+
+	frame_compose(workers, buffer, sources, weights, count, width, height, shown == NULL ? 0 : mix, statistics, NULL, NULL);
+}
+
+void keep_frame(uint8_t *shown, uint8_t *buffer, int width, int height)
+{
+	if (shown != NULL)
+	{
+		memcpy(shown, buffer, width * height * 3);
+	}
+}
+
+// Statistics gathered while converting are handed to the extension before it sees the frame, and give the brightness
+// to send with the next update when the average luminance is limited
+
+int measure_frame(frame_statistics *measured, int pixels, void (*statistics)(), int brightness, int limit, int level)
+{
+	if (statistics != NULL)
+	{
+		statistics(pixels, measured->sums, measured->histogram, FRAME_BINS, measured->maximum);
+	}
+
+	return limit > 0 ? frame_limit_brightness(measured, pixels, brightness, limit, level) : brightness;
+}
+
+// Tops the loader queue up to the limit given with the next sources of the playlist, once any changes to watched folders
+// have been applied. Returns the number of sources queued so far.
+
+int queue_sources(playlist *playlist, loader *loader, int queued, int limit)
+{
+	queued -= playlist_update(playlist, loader);
+
+	char *path;
+
+	while (queued < limit && (path = playlist_next(playlist)) != NULL && !loader_add(loader, path))
+	{
+		queued++;
+	}
+
+	return queued;
+}
+
+int add_source(uint8_t **sources, int *weights, int count, uint8_t *frame, uint8_t *following, int interpolation, int weight)
+{
+	int followingWeight = weight * interpolation / FADE_MAXIMUM;
+
+	if (weight - followingWeight > 0)
+	{
+		sources[count] = frame;
+		weights[count++] = weight - followingWeight;
+	}
+
+	if (followingWeight > 0)
+	{
+		sources[count] = following;
+		weights[count++] = followingWeight;
+	}
+
+	return count;
+}
+
+int main(int argc, char *argv[])
+{
+	timeline timeline = {
+		.origin = get_precise_time()
+	};
+
+	int status = EXIT_FAILURE;
+	char *port = NULL;
+	int width = 0;
+	int height = 0;
+	int brightness = 255;
+	int limit = 0;
+	int mix = 0;
+	int rate = 0;
+	int refresh = 0;
+	int crossfade = 0;
+	int output = 0;
+	int threads = 1;
+	char *extensionFile = NULL;
+	int deadline = 0;
+	char *displaysFile = NULL;
+	char *syncAddress = NULL;
+	bool syncLeader = false;
+	bool shuffle = false;
+	bool huge = false;
+	bool xdp = false;
+	bool latency = false;
+	bool verbose = false;
+	int sourcesLength = 0;
+	char **sources;
+	int areasLength = 0;
+	area *areas;
+
+	srand(time(NULL));
+
+	if ((sources = malloc((argc - 1) * sizeof(*sources))) == NULL)
+	{
+		perror("Failed to allocate memory for sources");
+		goto exit;
+	}
+
+	// Every zone can be preceded by a zone covering the whole display for sources given before the first one
+	if ((areas = calloc(argc, sizeof(*areas))) == NULL)
+	{
+		perror("Failed to allocate memory for zones");
+		goto free_sources;
+	}
+
+	for (int index = 1; index < argc; index++)
+	{
+		char *argument = argv[index];
+
+		if (argument[0] != '-')
+		{
+			sources[sourcesLength++] = argument;
+			continue;
+		}
+
+		bool failed = false;
+
+		switch (argument[1])
+		{
+			case 'p':
+				failed = ++index >= argc;
+				port = argv[index];
+				break;
+
+			case 'w':
+				failed = ++index >= argc || parse(argv[index], &width);
+				break;
+
+			case 'h':
+				failed = ++index >= argc || parse(argv[index], &height);
+				break;
+
+			case 'b':
+				failed = ++index >= argc || parse(argv[index], &brightness);
+				break;
+
+			case 'i':
+				failed = ++index >= argc || parse(argv[index], &limit);
+				break;
+
+			case 'm':
+				failed = ++index >= argc || parse(argv[index], &mix);
+				break;
+
+			case 'r':
+				failed = ++index >= argc || parse(argv[index], &rate);
+				break;
+
+			case 'o':
+				failed = ++index >= argc || parse(argv[index], &output);
+				break;
+
+			case 'c':
+				failed = ++index >= argc || parse(argv[index], &crossfade);
+				break;
+
+			case 'f':
+				failed = ++index >= argc || parse(argv[index], &refresh);
+				break;
+
+			case 't':
+				failed = ++index >= argc || parse(argv[index], &threads);
+				break;
+
+			case 'e':
+				failed = ++index >= argc;
+				extensionFile = argv[index];
+				break;
+
+			case 'x':
+				failed = ++index >= argc || parse(argv[index], &deadline);
+				break;
+
+			case 'd':
+				failed = ++index >= argc;
+				displaysFile = argv[index];
+				break;
+
+			case 'a':
+				failed = ++index >= argc || syncAddress != NULL;
+				syncAddress = argv[index];
+				syncLeader = true;
+				break;
+
+			case 'y':
+				failed = ++index >= argc || syncAddress != NULL;
+				syncAddress = argv[index];
+				break;
+
+			case 's':
+				shuffle = true;
+				break;
+
+			case 'u':
+				huge = true;
+				break;
+
+			case 'k':
+				xdp = true;
+				break;
+
+			case 'l':
+				latency = true;
+				break;
+
+			case 'z':
+				if (areasLength == 0 && sourcesLength > 0)
+				{
+					areasLength++;
+				}
+
+				failed = ++index >= argc || parse_area(argv[index], &areas[areasLength]);
+				areas[areasLength++].start = sourcesLength;
+				break;
+
+			case 'v':
+				verbose = true;
+				break;
+
+			default:
+				failed = true;
+		}
+
+		if (failed || argument[2] != 0)
+		{
+			puts("Usage:");
+			puts("  panelplayer -p <port> -w <width> -h <height> [options] <sources>");
+			puts("");
+			puts("Options:");
+			puts("  -p <port>       Set ethernet port");
+			puts("  -w <width>      Set display width");
+			puts("  -h <height>     Set display height");
+			puts("  -b <brightness> Set display brightness");
+			puts("  -i <luminance>  Limit average luminance");
+			puts("  -m <mix>        Set frame mixing percentage");
+			puts("  -r <rate>       Override source frame rate");
+			puts("  -o <rate>       Set output frame rate");
+			puts("  -c <crossfade>  Set crossfade duration");
+			puts("  -f <refresh>    Set static image refresh interval");
+			puts("  -t <threads>    Set decoding thread count");
+			puts("  -e <extension>  Load extension from file");
+			puts("  -x <deadline>   Run extension in a separate process");
+			puts("  -d <displays>   Drive displays listed in file");
+			puts("  -a <address>    Lead synchronized playback");
+			puts("  -y <port>       Follow synchronized playback");
+			puts("  -s              Shuffle sources");
+			puts("  -u              Use huge pages for buffers");
+			puts("  -k              Send packets with AF_XDP");
+			puts("  -l              Enable low latency mode");
+			puts("  -z <x,y,w,h>    Play following sources in a zone");
+			puts("  -v              Enable verbose output");
+
+			goto free_sources;
+		}
+	}
+
+	if (deadline < 0 || (deadline > 0 && extensionFile == NULL))
+	{
+		puts("Extension deadline must be a positive integer and requires an extension!");
+		goto free_sources;
+	}
+
+	if (displaysFile != NULL && (port != NULL || width > 0 || height > 0 || sourcesLength > 0))
+	{
+		puts("Ports, sizes and sources must be given in the displays file!");
+		goto free_sources;
+	}
+
+	if (displaysFile == NULL && port == NULL)
+	{
+		puts("Port must be specified!");
+		goto free_sources;
+	}
+
+	if (displaysFile == NULL && (width < 1 || height < 1))
+	{
+		puts("Width and height must be specified as positive integers!");
+		goto free_sources;
+	}
+
+	if (brightness < 0 || brightness > 255)
+	{
+		puts("Brightness must be an integer between 0 and 255!");
+		goto free_sources;
+	}
+
+	if (limit < 0 || limit > 255)
+	{
+		puts("Luminance limit must be an integer between 0 and 255!");
+		goto free_sources;
+	}
+
+	if (mix < 0 || mix >= MIX_MAXIMUM)
+	{
+		printf("Mix must be an integer between 0 and %d!\n", MIX_MAXIMUM - 1);
+		goto free_sources;
+	}
+
+	if (output < 0)
+	{
+		puts("Output frame rate must be a positive integer!");
+		goto free_sources;
+	}
+
+	if (crossfade < 0)
+	{
+		puts("Crossfade duration must be a positive integer!");
+		goto free_sources;
+	}
+
+	if (refresh < 0)
+	{
+		puts("Refresh interval must be a positive integer!");
+		goto free_sources;
+	}
+
+	if (threads < 1)
+	{
+		puts("Thread count must be a positive integer!");
+		goto free_sources;
+	}
+
+	if (displaysFile == NULL && sourcesLength == 0)
+	{
+		puts("At least one source must be specified!");
+		goto free_sources;
+	}
+
+	if (check_areas(areas, areasLength, sourcesLength, width, height))
+	{
+		goto free_sources;
+	}
+
+	for (int index = 0; areasLength > 0 && index < sourcesLength; index++)
+	{
+		if (playlist_is_folder(sources[index]))
+		{
+			puts("Folders can't be used with zones!");
+			goto free_sources;
+		}
+	}
+
+	if ((areasLength > 0 || displaysFile != NULL) && (crossfade > 0 || output > 0 || latency))
+	{
+		puts("Crossfade, output frame rate and low latency can't be used with zones or displays!");
+		goto free_sources;
+	}
+
+	if (syncAddress != NULL && (areasLength > 0 || displaysFile != NULL || crossfade > 0 || shuffle))
+	{
+		puts("Synchronized playback can't be used with zones, displays, crossfade or shuffle!");
+		goto free_sources;
+	}
+
+	pool *pool;
+
+	if ((pool = pool_init(huge)) == NULL)
+	{
+		puts("Failed to create pool instance!");
+		goto free_sources;
+	}
+
+	void *extension = NULL;
+	void (*update)() = NULL;
+	void (*statistics)() = NULL;
+
+	// Zones and displays listed in a file are played by compositors, which only send the rows of zones that have advanced
+	if (areasLength > 0 || displaysFile != NULL)
+	{
+		display single = {
+			.port = port,
+			.width = width,
+			.height = height,
+			.brightness = brightness,
+			.limit = limit,
+			.mix = mix,
+			.rate = rate,
+			.shuffle = shuffle,
+			.sources = sources,
+			.sourcesLength = sourcesLength,
+			.areas = areas,
+			.areasLength = areasLength
+		};
+
+		display *displays = &single;
+		int displaysLength = 1;
+		char *text = NULL;
+
+		if (displaysFile != NULL && (displays = read_displays(displaysFile, &text, &displaysLength, &single)) == NULL)
+		{
+			goto destroy_pool;
+		}
+
+		// Extensions with a deadline are loaded by host processes instead, one for every display
+		if (extensionFile != NULL && deadline == 0 && (extension = open_extension(extensionFile, &update, &statistics)) == NULL)
+		{
+			goto release_displays;
+		}
+
+		int hosted = 0;
+
+		// Every display has a host process of its own, so an extension that is late for one display holds up no others
+		for (; deadline > 0 && hosted < displaysLength; hosted++)
+		{
+			display *display = &displays[hosted];
+
+			if ((display->host = host_init(extensionFile, display->width, display->height, deadline)) == NULL)
+			{
+				puts("Failed to create host instance!");
+				break;
+			}
+		}
+
+		bool started = deadline == 0 || hosted == displaysLength;
+
+		// Hosts load the extension concurrently and are only waited for once all of them have been started
+		for (int index = 0; deadline > 0 && index < hosted; index++)
+		{
+			if (host_wait(displays[index].host) && started)
+			{
+				puts("Failed to create host instance!");
+				started = false;
+			}
+		}
+
+		if (started && !play_displays(displays, displaysLength, threads, xdp, update, statistics, pool, verbose))
+		{
+			status = EXIT_SUCCESS;
+		}
+
+		while (hosted > 0)
+		{
+			host_destroy(displays[--hosted].host);
+		}
+
+		if (extension != NULL)
+		{
+			close_extension(extension);
+		}
+
+	release_displays:
+		if (displays != &single)
+		{
+			free_displays(displays, displaysLength);
+			free(text);
+		}
+
+		goto destroy_pool;
+	}
+
+	host *host = NULL;
+
+	// The host process is started before the loader and workers, as their threads would not be carried into it. It loads
+	// the extension while the rest of the player starts.
+	if (deadline > 0)
+	{
+		if ((host = host_init(extensionFile, width, height, deadline)) == NULL)
+		{
+			puts("Failed to create host instance!");
+			goto destroy_pool;
+		}
+
+		mark(&timeline, "Started extension host");
+	}
+
+	uint8_t *buffer;
+
+	// Frames are composed straight into memory shared with the host so the extension never works on a copy
+	if (host != NULL)
+	{
+		buffer = host_get_buffer(host);
+	}
+	else if ((buffer = pool_get(pool, width * height * 3)) == NULL)
+	{
+		puts("Failed to get frame buffer!");
+		goto destroy_pool;
+	}
+
+	uint8_t *shown = NULL;
+
+	// A frame the extension misses its deadline on is composed again in the next slot, which has to start from the last
+	// frame shown for the two to be mixed. Which frames will be missed isn't known in advance, so every frame shown is
+	// copied aside while mixing.
+	if (host != NULL && mix > 0 && (shown = pool_get(pool, width * height * 3)) == NULL)
+	{
+		puts("Failed to get frame buffer!");
+		goto release_buffer;
+	}
+
+	playlist *playlist;
+
+	if ((playlist = playlist_init(sources, sourcesLength, shuffle, verbose)) == NULL)
+	{
+		puts("Failed to create playlist instance!");
+		goto release_buffer;
+	}
+
+	loader *loader;
+
+	// Files removed from a watched folder hold their place in the loader queue until playback reaches them
+	if ((loader = loader_init(QUEUE_SIZE * 2, pool, NULL)) == NULL)
+	{
+		puts("Failed to create loader instance!");
+		goto destroy_playlist;
+	}
+
+	// The first files are read while the port, workers and extension are set up
+	int queued = queue_sources(playlist, loader, 0, QUEUE_SIZE);
+	mark(&timeline, "Queued first sources");
+
+	setup setup = {
+		.port = port,
+		.xdp = xdp,
+		.extensionFile = deadline == 0 ? extensionFile : NULL,
+		.timeline = &timeline
+	};
+
+	pthread_t setupThread;
+
+	if (pthread_create(&setupThread, NULL, set_up, &setup))
+	{
+		puts("Failed to create setup thread!");
+		goto destroy_loader;
+	}
+
+	workers *workers = workers_init(threads, frame_get_stripes(width, height));
+	bool prepared = workers != NULL;
+
+	if (!prepared)
+	{
+		puts("Failed to create workers instance!");
+	}
+	else
+	{
+		mark(&timeline, "Started workers");
+	}
+
+	if (prepared && host != NULL)
+	{
+		if (host_wait(host))
+		{
+			puts("Failed to create host instance!");
+			prepared = false;
+		}
+		else
+		{
+			mark(&timeline, "Extension host ready");
+		}
+	}
+
+	scheduler *decoding = NULL;
+
+	// Animations are split between lanes which take turns on one scheduler shared by every decoder that is open
+	if (prepared && threads > 1 && (decoding = scheduler_init(threads)) == NULL)
+	{
+		puts("Failed to create scheduler instance!");
+		prepared = false;
+	}
+
+	int canvases;
+	int scratches;
+
+	decoder_get_buffers(threads, &canvases, &scratches);
+
+	// Buffers for every decoder that can be open at once, along with the frame each holds for interpolation, are
+	// allocated up front so playback never has to
+	if (prepared && (pool_reserve(pool, width * height * 4, DECODERS * (canvases + 1)) || pool_reserve(pool, (width + 1) * (height + 1) * 4, DECODERS * scratches)))
+	{
+		puts("Failed to reserve decoder buffers!");
+		prepared = false;
+	}
+
+	// Both threads are done before anything that either of them set up is used or cleaned up
+	pthread_join(setupThread, NULL);
+
+	colorlight *colorlight = setup.colorlight;
+	extension = setup.extension;
+	update = setup.update;
+	statistics = setup.statistics;
+
+	if (colorlight == NULL)
+	{
+		goto destroy_workers;
+	}
+
+	if (!prepared)
+	{
+		goto destroy_extension;
+	}
+
+	if (verbose && colorlight_has_xdp(colorlight))
+	{
+		printf("Sending packets on %s with AF_XDP.\n", port);
+	}
+
+	synchronizer *synchronizer = NULL;
+
+	if (syncAddress != NULL && (synchronizer = synchronizer_init(syncAddress, syncLeader)) == NULL)
+	{
+		puts("Failed to create synchronizer instance!");
+		goto destroy_extension;
+	}
+
+	transmission transmission = {
+		.colorlight = colorlight,
+		.width = width,
+		.buffer = buffer
+	};
+
+	frame_statistics measured;
+	frame_statistics *measuring = limit > 0 || statistics != NULL || (host != NULL && host_has_statistics(host)) ? &measured : NULL;
+	bool extended = update != NULL || host != NULL;
+	int level = brightness;
+	long next = get_time();
+	long budget = 0;
+	bool initial = true;
+	bool skip = false;
+	track *incoming = NULL;
+	int incomingStart = 0;
+
+	for (int source = 0;; source++)
+	{
+		queued = queue_sources(playlist, loader, queued, source + QUEUE_SIZE);
+
+		// Watched folders that have nothing left to play are checked again until something arrives
+		while (queued == source && playlist_is_watching(playlist))
+		{
+			await(get_time() + HOLD_DELAY);
+
+			next = get_time();
+			queued = queue_sources(playlist, loader, queued, source + QUEUE_SIZE);
+		}
+
+		if (queued == source)
+		{
+			break;
+		}
+
+		track *track = incoming;
+		int time = incomingStart;
+		long start = next;
+		bool pending = track != NULL;
+
+		incoming = NULL;
+		incomingStart = 0;
+
+		if (skip)
+		{
+			skip = false;
+			continue;
+		}
+
+		int size;
+
+		if (track == NULL)
+		{
+			void *file;
+
+			if ((file = loader_get(loader, &size)) == NULL)
+			{
+				continue;
+			}
+
+			if (initial)
+			{
+				mark(&timeline, "Loaded first source");
+			}
+
+			if ((track = open_source(file, size, width, height, rate, output > 0, threads, decoding, pool, verbose)) == NULL)
+			{
+				continue;
+			}
+
+			if (initial)
+			{
+				mark(&timeline, "Opened decoder");
+			}
+		}
+
+		int frames;
+		int duration;
+		int canvasWidth;
+		int canvasHeight;
+
+		track_get_info(track, &frames, &duration, &canvasWidth, &canvasHeight);
+
+		long allocations = pool_get_allocations(pool);
+		int played = 0;
+		int origin = time;
+		bool settled = false;
+		int fade = -1;
+		long latencies = 0;
+		int skipped = 0;
+		long levels = 0;
+		uint8_t *decoded = NULL;
+
+		while (played == 0 || pending || (output > 0 ? time < duration : track_has_next(track)))
+		{
+			uint8_t *following = NULL;
+			int interpolation = 0;
+			int oldFactor = initial ? 0 : mix;
+			int end;
+
+			// Followers take the time each frame is due from the leader whenever the leader has shown the same source
+			long due;
+			bool late;
+			bool locked = synchronizer != NULL && synchronizer_schedule(synchronizer, source, time, &due, &late);
+
+			if (locked)
+			{
+				next = due / 1000;
+			}
+
+			// Low latency mode starts on a frame only as long before it is due as the last frames took to prepare
+			if (latency)
+			{
+				await(next - budget - UPDATE_DELAY);
+			}
+
+			long started = get_time();
+
+			// The first frame is sent as it is decoded unless it has to pass through an extension or wait for a leader
+			streaming streaming = {
+				.transmission = &transmission,
+				.mix = oldFactor,
+				.statistics = measuring,
+				.send = !extended,
+				.progressive = initial && !extended && output == 0 && synchronizer == NULL,
+				.level = level,
+				.timeline = &timeline
+			};
+
+			if (measuring != NULL)
+			{
+				memset(measuring, 0, sizeof(*measuring));
+			}
+
+			// A fixed output rate samples sources at each output time rather than showing every decoded frame
+			if (output > 0 || pending)
+			{
+				decoded = track_sample(track, time, output > 0 ? &following : NULL, &interpolation, &end);
+			}
+			else if ((latency && frames == 1) || streaming.progressive)
+			{
+				decoded = track_stream_next(track, &end, stream_rows, &streaming);
+			}
+			else
+			{
+				decoded = track_get_next(track, &end);
+			}
+
+			if (decoded == NULL)
+			{
+				break;
+			}
+
+			if (output > 0)
+			{
+				end = origin + (played + 1) * 1000 / output;
+			}
+			else if (end < time)
+			{
+				end = time;
+			}
+
+			pending = false;
+
+			// A follower that has fallen behind drops frames until it is showing the frame the leader is showing
+			if (locked && frames > 1 && (late || due + (end - time) * 1000L < get_precise_time()))
+			{
+				time = end;
+				skipped++;
+				continue;
+			}
+
+			// The next source starts decoding once the remaining time fits within the crossfade
+			if (crossfade > 0 && fade < 0 && frames > 1 && duration > time && duration - time <= crossfade && source + 1 < queued)
+			{
+				void *file;
+
+				fade = time;
+
+				// The next source is taken from the queue either way, so it is skipped if it can't be read or opened
+				if ((file = loader_get(loader, &size)) == NULL || (incoming = open_source(file, size, width, height, rate, output > 0, threads, decoding, pool, verbose)) == NULL)
+				{
+					skip = true;
+				}
+			}
+
+			uint8_t *sources[FRAME_SOURCES];
+			int weights[FRAME_SOURCES];
+			int weight = 0;
+			uint8_t *incomingFrame = NULL;
+			uint8_t *incomingFollowing = NULL;
+			int incomingInterpolation = 0;
+			int incomingEnd;
+
+			if (incoming != NULL && (incomingFrame = track_sample(incoming, time - fade, output > 0 ? &incomingFollowing : NULL, &incomingInterpolation, &incomingEnd)) != NULL)
+			{
+				weight = (time - fade) * FADE_MAXIMUM / (duration - fade);
+			}
+
+			int count = add_source(sources, weights, 0, decoded, following, interpolation, FADE_MAXIMUM - weight);
+			count = add_source(sources, weights, count, incomingFrame, incomingFollowing, incomingInterpolation, weight);
+
+			// Streamed images are converted as rows are decoded, otherwise each stripe is sent as soon as it has been composed
+			if (streaming.rows > 0)
+			{
+				settled = !streaming.changed || oldFactor == 0;
+
+				// Rows of a progressive frame decoded since rows were last sent go out ahead of the update for the frame
+				if (streaming.progressive && streaming.sentRows < streaming.rows)
+				{
+					send_rows(&transmission, streaming.sentRows, streaming.rows - streaming.sentRows);
+				}
+			}
+			else
+			{
+				settled = !frame_compose(workers, buffer, sources, weights, count, width, height, oldFactor, measuring, extended ? NULL : send_rows, &transmission) || oldFactor == 0;
+			}
+
+			if (measuring != NULL)
+			{
+				level = measure_frame(measuring, width * height, statistics, brightness, limit, level);
+			}
+
+			if (update != NULL)
+			{
+				update(width, height, buffer);
+			}
+			else if (host != NULL && !host_update(host, measuring))
+			{
+				// The extension keeps the frame it missed the deadline on, so the frame is composed again in the next slot
+				buffer = transmission.buffer = host_get_buffer(host);
+				retry_frame(workers, buffer, shown, sources, weights, count, width, height, oldFactor, measuring);
+			}
+
+			if (extended)
+			{
+				send_rows(&transmission, 0, height);
+				keep_frame(shown, buffer, width, height);
+			}
+
+			// The estimate follows slower frames immediately and decays slowly after faster ones
+			long preparation = get_time() - started;
+			budget = preparation > budget ? preparation : (budget * 7 + preparation) / 8;
+
+			if (next - get_time() < UPDATE_DELAY)
+			{
+				next = get_time() + UPDATE_DELAY;
+			}
+
+			// Synchronized updates are timed to the microsecond, and a follower that is ahead holds the current frame
+			// until the leader reaches the next one
+			if (synchronizer != NULL)
+			{
+				await_precise(locked && due / 1000 >= next ? due : next * 1000L);
+			}
+			else
+			{
+				await(next);
+			}
+
+			colorlight_send_update(colorlight, level, level, level);
+
+			if (initial)
+			{
+				show(&timeline, "Showed first frame");
+
+				if (verbose)
+				{
+					print_timeline(&timeline);
+				}
+			}
+
+			latencies += get_time() - started;
+			levels += level;
+
+			next = get_time() + end - time;
+
+			if (synchronizer != NULL)
+			{
+				synchronizer_mark(synchronizer, source, time, end, next * 1000L);
+			}
+
+			time = end;
+
+			played++;
+			initial = false;
+		}
+
+		// The next source continues from the point the crossfade reached
+		if (incoming != NULL)
+		{
+			incomingStart = duration - fade;
+		}
+
+		if (verbose)
+		{
+			float seconds = (next - start) / 1000.0;
+			printf("Played %d frames in %.2f seconds at an average rate of %.2f frames per second.\n", played, seconds, played / seconds);
+			printf("Allocated %ld buffers during playback.\n", pool_get_allocations(pool) - allocations);
+
+			if (played > 0)
+			{
+				printf("Average latency from decode to display was %.2f milliseconds.\n", (float)latencies / played);
+			}
+
+			if (host != NULL)
+			{
+				int hostFrames;
+				int missed;
+				long handoff;
+				long handback;
+
+				host_get_latency(host, &hostFrames, &missed, &handoff, &handback);
+				printf("Extension missed the deadline for %d of %d frames and took %ld microseconds to receive frames and %ld microseconds to return them.\n", missed, hostFrames, handoff, handback);
+			}
+
+			if (played > 0 && limit > 0)
+			{
+				printf("Average brightness after limiting luminance was %.2f.\n", (float)levels / played);
+			}
+
+			if (synchronizer != NULL && !syncLeader)
+			{
+				int matched;
+				long average;
+				long maximum;
+
+				synchronizer_get_error(synchronizer, &matched, &average, &maximum);
+				printf("Skipped %d frames to keep up with the leader.\n", skipped);
+				printf("Sync error averaged %ld microseconds with a maximum of %ld microseconds over %d frames.\n", average, maximum, matched);
+			}
+		}
+
+		// Static images are held on the display with update packets rather than being sent every frame
+		if (frames == 1 && decoded != NULL)
+		{
+			bool watching = playlist_is_watching(playlist);
+			int entries;
+			int changes;
+
+			playlist_get_info(playlist, &entries, &changes);
+
+			// A watched folder holding nothing but this image holds it too, for as long as the folder stays the same
+			bool loop = watching ? entries == 1 : shuffle && sourcesLength == 1;
+			long refreshed = get_time();
+			long reported = refreshed;
+			long packets = colorlight_get_packets(colorlight);
+
+			if (verbose && loop)
+			{
+				puts("Holding static image.");
+			}
+
+			while (loop || next - get_time() > HOLD_DELAY)
+			{
+				long delay = HOLD_DELAY;
+
+				if (!settled)
+				{
+					int weight = FADE_MAXIMUM;
+					settled = !frame_compose(workers, buffer, &decoded, &weight, 1, width, height, mix, measuring, NULL, NULL);
+
+					if (measuring != NULL)
+					{
+						level = measure_frame(measuring, width * height, statistics, brightness, limit, level);
+					}
+
+					if (update != NULL)
+					{
+						update(width, height, buffer);
+					}
+					else if (host != NULL && !host_update(host, measuring))
+					{
+						buffer = transmission.buffer = host_get_buffer(host);
+						retry_frame(workers, buffer, shown, &decoded, &weight, 1, width, height, mix, measuring);
+					}
+
+					keep_frame(shown, buffer, width, height);
+
+					delay = UPDATE_DELAY;
+				}
+				else if (limit > 0)
+				{
+					// Brightness held back by the limit keeps recovering while the image is held
+					level = frame_limit_brightness(measuring, width * height, brightness, limit, level);
+				}
+
+				if (!settled || (refresh > 0 && get_time() - refreshed >= refresh * 1000))
+				{
+					send_rows(&transmission, 0, height);
+					refreshed = get_time();
+				}
+
+				await(get_time() + delay);
+				colorlight_send_update(colorlight, level, level, level);
+
+				if (loop && watching)
+				{
+					int current;
+
+					queued = queue_sources(playlist, loader, queued, source + QUEUE_SIZE);
+					playlist_get_info(playlist, &entries, &current);
+
+					if (current != changes)
+					{
+						loop = false;
+						next = get_time();
+					}
+				}
+
+				if (verbose && get_time() - reported >= REPORT_DELAY)
+				{
+					float seconds = (get_time() - reported) / 1000.0;
+					printf("Sent %ld packets in %.2f seconds at an average rate of %.2f packets per second.\n", colorlight_get_packets(colorlight) - packets, seconds, (colorlight_get_packets(colorlight) - packets) / seconds);
+
+					reported = get_time();
+					packets = colorlight_get_packets(colorlight);
+				}
+			}
+		}
+
+		track_destroy(track);
+	}
+
+	await(next);
+	status = EXIT_SUCCESS;
+
+	if (synchronizer != NULL)
+	{
+		synchronizer_destroy(synchronizer);
+	}
+
+destroy_extension:
+	if (extension != NULL)
+	{
+		close_extension(extension);
+	}
+
+	colorlight_destroy(colorlight);
+
+destroy_workers:
+	if (decoding != NULL)
+	{
+		scheduler_destroy(decoding);
+	}
+
+	if (workers != NULL)
+	{
+		workers_destroy(workers);
+	}
+
+destroy_loader:
+	loader_destroy(loader);
+
+destroy_playlist:
+	playlist_destroy(playlist);
+
+release_buffer:
+	if (shown != NULL)
+	{
+		pool_release(pool, shown);
+	}
+
+	if (host != NULL)
+	{
+		host_destroy(host);
+	}
+	else
+	{
+		pool_release(pool, buffer);
+	}
 
-free_buffer:
-	free(buffer);
+destroy_pool:
+	pool_destroy(pool);
 
 free_sources:
+	free(areas);
 	free(sources);
 
 exit:
@@ -0,0 +1,389 @@
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "playlist.h"
+
+typedef struct playlist_entry
+{
+	char *path;
+	bool owned;
+} playlist_entry;
+
+typedef struct playlist_folder
+{
+	int watch;
+	char *path;
+} playlist_folder;
+
+struct playlist
+{
+	playlist_entry *entries;
+	int length;
+	int capacity;
+	int cursor;
+	playlist_folder *folders;
+	int foldersLength;
+	int changes;
+	int notify;
+	bool shuffle;
+	bool verbose;
+};
+
+static char *join(char *folder, char *name)
+{
+	char *path;
+
+	if ((path = malloc(strlen(folder) + strlen(name) + 2)) == NULL)
+	{
+		perror("Failed to allocate memory for path");
+		return NULL;
+	}
+
+	sprintf(path, "%s/%s", folder, name);
+	return path;
+}
+
+// Hidden files are skipped, which leaves out the temporary files most tools write before moving a file into place
+
+static int is_visible(const struct dirent *entry)
+{
+	return entry->d_name[0] != '.' && entry->d_type != DT_DIR;
+}
+
+static int find(playlist *instance, char *path)
+{
+	for (int index = 0; index < instance->length; index++)
+	{
+		if (strcmp(instance->entries[index].path, path) == 0)
+		{
+			return index;
+		}
+	}
+
+	return -1;
+}
+
+static bool insert(playlist *instance, int position, char *path, bool owned)
+{
+	if (instance->length == instance->capacity)
+	{
+		int capacity = instance->capacity > 0 ? instance->capacity * 2 : 16;
+		playlist_entry *entries;
+
+		if ((entries = realloc(instance->entries, capacity * sizeof(*entries))) == NULL)
+		{
+			perror("Failed to allocate memory for playlist");
+			return true;
+		}
+
+		instance->entries = entries;
+		instance->capacity = capacity;
+	}
+
+	memmove(&instance->entries[position + 1], &instance->entries[position], (instance->length - position) * sizeof(*instance->entries));
+
+	instance->entries[position].path = path;
+	instance->entries[position].owned = owned;
+	instance->length++;
+
+	if (position < instance->cursor)
+	{
+		instance->cursor++;
+	}
+
+	return false;
+}
+
+// The loader keeps a copy of every path it is given, so a removed path can be freed straight away
+
+static void remove_entry(playlist *instance, int index)
+{
+	playlist_entry entry = instance->entries[index];
+
+	memmove(&instance->entries[index], &instance->entries[index + 1], (instance->length - index - 1) * sizeof(*instance->entries));
+	instance->length--;
+
+	if (index < instance->cursor)
+	{
+		instance->cursor--;
+	}
+
+	if (entry.owned)
+	{
+		free(entry.path);
+	}
+}
+
+// Files only count once they have been written in full or moved into place, so partly written files are never played
+
+static bool add_folder(playlist *instance, char *path)
+{
+	if (instance->notify == -1 && (instance->notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1)
+	{
+		perror("Failed to create inotify instance");
+		return true;
+	}
+
+	playlist_folder *folders;
+
+	if ((folders = realloc(instance->folders, (instance->foldersLength + 1) * sizeof(*folders))) == NULL)
+	{
+		perror("Failed to allocate memory for folders");
+		return true;
+	}
+
+	instance->folders = folders;
+
+	playlist_folder *folder = &instance->folders[instance->foldersLength];
+
+	if ((folder->watch = inotify_add_watch(instance->notify, path, IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM)) == -1)
+	{
+		perror("Failed to watch folder");
+		return true;
+	}
+
+	folder->path = path;
+	instance->foldersLength++;
+
+	struct dirent **names;
+	int count;
+
+	if ((count = scandir(path, &names, is_visible, alphasort)) == -1)
+	{
+		perror("Failed to read folder");
+		return true;
+	}
+
+	bool failed = false;
+
+	for (int index = 0; index < count; index++)
+	{
+		char *entry = failed ? NULL : join(path, names[index]->d_name);
+		unsigned char type = names[index]->d_type;
+
+		free(names[index]);
+
+		// Some filesystems don't report what an entry is, and a link may lead to a folder, so those are checked in full
+		if (entry != NULL && (type == DT_UNKNOWN || type == DT_LNK) && playlist_is_folder(entry))
+		{
+			free(entry);
+			continue;
+		}
+
+		if (entry == NULL || insert(instance, instance->length, entry, true))
+		{
+			free(entry);
+			failed = true;
+		}
+	}
+
+	free(names);
+	return failed;
+}
+
+bool playlist_is_folder(char *path)
+{
+	struct stat status;
+	return stat(path, &status) == 0 && S_ISDIR(status.st_mode);
+}
+
+// Folders among the sources are replaced by the files they hold in alphabetical order, and are then watched for files
+// being added, removed or replaced
+
+playlist *playlist_init(char **sources, int sourcesLength, bool shuffle, bool verbose)
+{
+	playlist *instance;
+
+	if ((instance = calloc(1, sizeof(*instance))) == NULL)
+	{
+		perror("Failed to allocate memory for instance");
+		return NULL;
+	}
+
+	instance->notify = -1;
+	instance->shuffle = shuffle;
+	instance->verbose = verbose;
+
+	for (int index = 0; index < sourcesLength; index++)
+	{
+		if (playlist_is_folder(sources[index]) ? add_folder(instance, sources[index]) : insert(instance, instance->length, sources[index], false))
+		{
+			playlist_destroy(instance);
+			return NULL;
+		}
+	}
+
+	return instance;
+}
+
+bool playlist_is_watching(playlist *instance)
+{
+	return instance->notify != -1;
+}
+
+// The number of changes counts every file added, replaced or removed in watched folders, so callers can tell whether
+// anything has changed since they last looked
+
+void playlist_get_info(playlist *instance, int *length, int *changes)
+{
+	*length = instance->length;
+	*changes = instance->changes;
+}
+
+// Returns the next source to queue, or NULL once every source has been queued. Playlists with watched folders repeat,
+// as their contents can change while they play.
+
+char *playlist_next(playlist *instance)
+{
+	if (instance->length == 0)
+	{
+		return NULL;
+	}
+
+	if (instance->shuffle)
+	{
+		return instance->entries[rand() % instance->length].path;
+	}
+
+	if (instance->cursor >= instance->length)
+	{
+		if (instance->notify == -1)
+		{
+			return NULL;
+		}
+
+		instance->cursor = 0;
+	}
+
+	return instance->entries[instance->cursor++].path;
+}
+
+// Applies the changes seen in watched folders since the last call, updating queued files in place rather than reading
+// the folders again. New files are played next. Returns the number of queued files that were dropped.
+
+int playlist_update(playlist *instance, loader *loader)
+{
+	int removed = 0;
+
+	if (instance->notify == -1)
+	{
+		return removed;
+	}
+
+	char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t length;
+
+	while ((length = read(instance->notify, events, sizeof(events))) > 0)
+	{
+		struct inotify_event *event;
+
+		for (char *position = events; position < events + length; position += sizeof(*event) + event->len)
+		{
+			event = (struct inotify_event *)position;
+
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				puts("Some folder changes were missed!");
+			}
+
+			if (event->len == 0 || event->name[0] == '.' || (event->mask & IN_ISDIR))
+			{
+				continue;
+			}
+
+			char *folder = NULL;
+
+			for (int index = 0; index < instance->foldersLength; index++)
+			{
+				if (instance->folders[index].watch == event->wd)
+				{
+					folder = instance->folders[index].path;
+				}
+			}
+
+			char *path;
+
+			if (folder == NULL || (path = join(folder, event->name)) == NULL)
+			{
+				continue;
+			}
+
+			int index = find(instance, path);
+
+			if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+			{
+				if (index >= 0)
+				{
+					removed += loader_remove(loader, path);
+					remove_entry(instance, index);
+					instance->changes++;
+
+					if (instance->verbose)
+					{
+						printf("Removed %s from playlist.\n", path);
+					}
+				}
+
+				free(path);
+			}
+			else if (index >= 0)
+			{
+				loader_reload(loader, path);
+				instance->changes++;
+
+				if (instance->verbose)
+				{
+					printf("Reloading %s.\n", path);
+				}
+
+				free(path);
+			}
+			else if (insert(instance, instance->cursor, path, true))
+			{
+				free(path);
+			}
+			else
+			{
+				instance->changes++;
+
+				if (instance->verbose)
+				{
+					printf("Added %s to playlist.\n", path);
+				}
+			}
+		}
+	}
+
+	if (length == -1 && errno != EAGAIN)
+	{
+		perror("Failed to read folder changes");
+	}
+
+	return removed;
+}
+
+void playlist_destroy(playlist *instance)
+{
+	if (instance->notify != -1)
+	{
+		close(instance->notify);
+	}
+
+	for (int index = 0; index < instance->length; index++)
+	{
+		if (instance->entries[index].owned)
+		{
+			free(instance->entries[index].path);
+		}
+	}
+
+	free(instance->folders);
+	free(instance->entries);
+	free(instance);
+}
\ No newline at end of file
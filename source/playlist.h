@@ -0,0 +1,18 @@
+#ifndef PLAYLIST_H
+#define PLAYLIST_H
+
+#include <stdbool.h>
+
+#include "loader.h"
+
+typedef struct playlist playlist;
+
+bool playlist_is_folder(char *path);
+playlist *playlist_init(char **sources, int sourcesLength, bool shuffle, bool verbose);
+bool playlist_is_watching(playlist *instance);
+void playlist_get_info(playlist *instance, int *length, int *changes);
+char *playlist_next(playlist *instance);
+int playlist_update(playlist *instance, loader *loader);
+void playlist_destroy(playlist *instance);
+
+#endif
\ No newline at end of file
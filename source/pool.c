@@ -0,0 +1,294 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "pool.h"
+
+#define CACHE_LINE 64
+#define HUGE_PAGE (2 * 1024 * 1024)
+#define MINIMUM_CLASS 12
+#define CLASSES 32
+#define DEPTH 8
+
+typedef struct pool_header
+{
+	struct pool_header *next;
+	struct pool_header *following;
+	char *data;
+	int class;
+	bool mapped;
+	bool reserved;
+} pool_header;
+
+_Static_assert(sizeof(pool_header) <= CACHE_LINE, "Pool header must fit within a cache line");
+
+struct pool
+{
+	bool huge;
+	pool_header *available[CLASSES];
+	int count[CLASSES];
+	pool_header *reserved[CLASSES];
+	pool_header *mapped;
+	long allocations;
+	pthread_mutex_t lock;
+};
+
+static int get_class(int size)
+{
+	int class = MINIMUM_CLASS;
+
+	while ((1L << class) < size)
+	{
+		class++;
+	}
+
+	return class;
+}
+
+static void release(pool_header *header)
+{
+	if (header->mapped)
+	{
+		munmap(header->data, 1L << header->class);
+	}
+
+	free(header);
+}
+
+// Buffers that span whole huge pages are backed by them when possible, with their header allocated apart so the
+// buffer fills its pages exactly. Every other buffer is cache line aligned with its header in the cache line before it.
+
+static pool_header *allocate(pool *instance, int class)
+{
+	pool_header *header = NULL;
+
+	if (instance->huge && (1L << class) >= HUGE_PAGE)
+	{
+		void *data = mmap(NULL, 1L << class, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+		if (data != MAP_FAILED && (header = malloc(sizeof(*header))) == NULL)
+		{
+			perror("Failed to allocate memory for buffer header");
+			munmap(data, 1L << class);
+			return NULL;
+		}
+
+		if (header != NULL)
+		{
+			header->data = data;
+			header->mapped = true;
+
+			pthread_mutex_lock(&instance->lock);
+			header->following = instance->mapped;
+			instance->mapped = header;
+			pthread_mutex_unlock(&instance->lock);
+		}
+	}
+
+	if (header == NULL)
+	{
+		if (posix_memalign((void **)&header, CACHE_LINE, (1L << class) + CACHE_LINE))
+		{
+			perror("Failed to allocate memory for buffer");
+			return NULL;
+		}
+
+		header->data = (char *)header + CACHE_LINE;
+		header->mapped = false;
+	}
+
+	header->class = class;
+	header->reserved = false;
+
+	return header;
+}
+
+// Called with the lock held. Buffers backed by huge pages are looked up by their address, as their header is kept apart.
+
+static pool_header *find(pool *instance, void *data)
+{
+	for (pool_header *header = instance->mapped; header != NULL; header = header->following)
+	{
+		if (header->data == data)
+		{
+			return header;
+		}
+	}
+
+	return (pool_header *)((char *)data - CACHE_LINE);
+}
+
+// Called with the lock held
+
+static void forget(pool *instance, pool_header *header)
+{
+	pool_header **link = &instance->mapped;
+
+	while (*link != header)
+	{
+		link = &(*link)->following;
+	}
+
+	*link = header->following;
+}
+
+pool *pool_init(bool huge)
+{
+	pool *instance;
+
+	if ((instance = calloc(1, sizeof(*instance))) == NULL)
+	{
+		perror("Failed to allocate memory for instance");
+		return NULL;
+	}
+
+	instance->huge = huge;
+	pthread_mutex_init(&instance->lock, NULL);
+
+	return instance;
+}
+
+void *pool_get(pool *instance, int size)
+{
+	int class = get_class(size);
+
+	pthread_mutex_lock(&instance->lock);
+
+	pool_header *header = instance->available[class];
+
+	if (header != NULL)
+	{
+		instance->available[class] = header->next;
+		instance->count[class]--;
+	}
+	else
+	{
+		instance->allocations++;
+	}
+
+	pthread_mutex_unlock(&instance->lock);
+
+	if (header == NULL && (header = allocate(instance, class)) == NULL)
+	{
+		return NULL;
+	}
+
+	return header->data;
+}
+
+// Reserved buffers are only handed out here, so buffers taken for anything else never use up a reservation. Buffers
+// are taken as usual once every reserved one is in use.
+
+void *pool_get_reserved(pool *instance, int size)
+{
+	int class = get_class(size);
+
+	pthread_mutex_lock(&instance->lock);
+
+	pool_header *header = instance->reserved[class];
+
+	if (header != NULL)
+	{
+		instance->reserved[class] = header->next;
+	}
+
+	pthread_mutex_unlock(&instance->lock);
+
+	return header != NULL ? header->data : pool_get(instance, size);
+}
+
+void pool_release(pool *instance, void *data)
+{
+	if (data == NULL)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&instance->lock);
+
+	pool_header *header = find(instance, data);
+
+	if (header->reserved)
+	{
+		header->next = instance->reserved[header->class];
+		instance->reserved[header->class] = header;
+		header = NULL;
+	}
+	else if (instance->count[header->class] < DEPTH)
+	{
+		header->next = instance->available[header->class];
+		instance->available[header->class] = header;
+		instance->count[header->class]++;
+		header = NULL;
+	}
+	else if (header->mapped)
+	{
+		forget(instance, header);
+	}
+
+	pthread_mutex_unlock(&instance->lock);
+
+	if (header != NULL)
+	{
+		release(header);
+	}
+}
+
+// Reservations add up, so every caller gets buffers of its own. Reserved buffers are kept for the life of the pool.
+
+bool pool_reserve(pool *instance, int size, int count)
+{
+	int class = get_class(size);
+
+	for (int index = 0; index < count; index++)
+	{
+		pool_header *header;
+
+		if ((header = allocate(instance, class)) == NULL)
+		{
+			return true;
+		}
+
+		header->reserved = true;
+
+		pthread_mutex_lock(&instance->lock);
+		header->next = instance->reserved[class];
+		instance->reserved[class] = header;
+		pthread_mutex_unlock(&instance->lock);
+	}
+
+	return false;
+}
+
+long pool_get_allocations(pool *instance)
+{
+	pthread_mutex_lock(&instance->lock);
+	long allocations = instance->allocations;
+	pthread_mutex_unlock(&instance->lock);
+
+	return allocations;
+}
+
+void pool_destroy(pool *instance)
+{
+	for (int class = 0; class < CLASSES; class++)
+	{
+		while (instance->available[class] != NULL)
+		{
+			pool_header *header = instance->available[class];
+			instance->available[class] = header->next;
+			release(header);
+		}
+
+		while (instance->reserved[class] != NULL)
+		{
+			pool_header *header = instance->reserved[class];
+			instance->reserved[class] = header->next;
+			release(header);
+		}
+	}
+
+	pthread_mutex_destroy(&instance->lock);
+	free(instance);
+}
\ No newline at end of file
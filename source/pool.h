@@ -0,0 +1,16 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h>
+
+typedef struct pool pool;
+
+pool *pool_init(bool huge);
+void *pool_get(pool *instance, int size);
+void *pool_get_reserved(pool *instance, int size);
+void pool_release(pool *instance, void *data);
+bool pool_reserve(pool *instance, int size, int count);
+long pool_get_allocations(pool *instance);
+void pool_destroy(pool *instance);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,221 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "scheduler.h"
+
+typedef struct scheduler_job
+{
+	long deadline;
+	long sequence;
+	scheduler_function function;
+	void *context;
+} scheduler_job;
+
+struct scheduler
+{
+	int threads;
+	pthread_t *thread;
+	scheduler_job *jobs;
+	int length;
+	int capacity;
+	long sequence;
+	bool destroyed;
+	pthread_mutex_t lock;
+	pthread_cond_t condition;
+};
+
+// Jobs are kept in a binary heap ordered by deadline so the job due soonest always runs first. Jobs with the same
+// deadline run in the order they were submitted.
+
+static bool before(scheduler_job *first, scheduler_job *second)
+{
+	return first->deadline < second->deadline || (first->deadline == second->deadline && first->sequence < second->sequence);
+}
+
+static void swap(scheduler *instance, int first, int second)
+{
+	scheduler_job job = instance->jobs[first];
+	instance->jobs[first] = instance->jobs[second];
+	instance->jobs[second] = job;
+}
+
+static scheduler_job take(scheduler *instance)
+{
+	scheduler_job job = instance->jobs[0];
+	instance->jobs[0] = instance->jobs[--instance->length];
+
+	for (int index = 0;;)
+	{
+		int smallest = index;
+		int left = index * 2 + 1;
+		int right = left + 1;
+
+		if (left < instance->length && before(&instance->jobs[left], &instance->jobs[smallest]))
+		{
+			smallest = left;
+		}
+
+		if (right < instance->length && before(&instance->jobs[right], &instance->jobs[smallest]))
+		{
+			smallest = right;
+		}
+
+		if (smallest == index)
+		{
+			break;
+		}
+
+		swap(instance, index, smallest);
+		index = smallest;
+	}
+
+	return job;
+}
+
+static void *scheduler_process(void *parameter)
+{
+	scheduler *instance = parameter;
+	pthread_mutex_lock(&instance->lock);
+
+	while (true)
+	{
+		while (!instance->destroyed && instance->length == 0)
+		{
+			pthread_cond_wait(&instance->condition, &instance->lock);
+		}
+
+		// Queued jobs are still run when destroyed so anyone waiting on them is never left waiting
+		if (instance->length == 0)
+		{
+			break;
+		}
+
+		scheduler_job job = take(instance);
+		pthread_mutex_unlock(&instance->lock);
+
+		job.function(job.context);
+
+		pthread_mutex_lock(&instance->lock);
+	}
+
+	pthread_mutex_unlock(&instance->lock);
+	return NULL;
+}
+
+scheduler *scheduler_init(int threads)
+{
+	scheduler *instance;
+
+	if ((instance = calloc(1, sizeof(*instance))) == NULL)
+	{
+		perror("Failed to allocate memory for instance");
+		return NULL;
+	}
+
+	if ((instance->thread = calloc(threads, sizeof(*instance->thread))) == NULL)
+	{
+		perror("Failed to allocate memory for threads");
+		goto free_instance;
+	}
+
+	pthread_mutex_init(&instance->lock, NULL);
+	pthread_cond_init(&instance->condition, NULL);
+
+	for (; instance->threads < threads; instance->threads++)
+	{
+		if (pthread_create(&instance->thread[instance->threads], NULL, scheduler_process, instance))
+		{
+			puts("Failed to create scheduler thread!");
+			goto join_threads;
+		}
+	}
+
+	return instance;
+
+join_threads:
+	pthread_mutex_lock(&instance->lock);
+
+	instance->destroyed = true;
+	pthread_cond_broadcast(&instance->condition);
+
+	pthread_mutex_unlock(&instance->lock);
+
+	for (int thread = 0; thread < instance->threads; thread++)
+	{
+		pthread_join(instance->thread[thread], NULL);
+	}
+
+	pthread_cond_destroy(&instance->condition);
+	pthread_mutex_destroy(&instance->lock);
+
+	free(instance->thread);
+
+free_instance:
+	free(instance);
+	return NULL;
+}
+
+bool scheduler_submit(scheduler *instance, long deadline, scheduler_function function, void *context)
+{
+	pthread_mutex_lock(&instance->lock);
+
+	bool failed = false;
+
+	if (instance->length == instance->capacity)
+	{
+		int capacity = instance->capacity > 0 ? instance->capacity * 2 : 16;
+		scheduler_job *jobs;
+
+		if ((jobs = realloc(instance->jobs, capacity * sizeof(*jobs))) == NULL)
+		{
+			perror("Failed to allocate memory for jobs");
+			failed = true;
+			goto unlock;
+		}
+
+		instance->jobs = jobs;
+		instance->capacity = capacity;
+	}
+
+	int index = instance->length++;
+
+	instance->jobs[index].deadline = deadline;
+	instance->jobs[index].sequence = instance->sequence++;
+	instance->jobs[index].function = function;
+	instance->jobs[index].context = context;
+
+	while (index > 0 && before(&instance->jobs[index], &instance->jobs[(index - 1) / 2]))
+	{
+		swap(instance, index, (index - 1) / 2);
+		index = (index - 1) / 2;
+	}
+
+	pthread_cond_signal(&instance->condition);
+
+unlock:
+	pthread_mutex_unlock(&instance->lock);
+	return failed;
+}
+
+void scheduler_destroy(scheduler *instance)
+{
+	pthread_mutex_lock(&instance->lock);
+
+	instance->destroyed = true;
+	pthread_cond_broadcast(&instance->condition);
+
+	pthread_mutex_unlock(&instance->lock);
+
+	for (int thread = 0; thread < instance->threads; thread++)
+	{
+		pthread_join(instance->thread[thread], NULL);
+	}
+
+	pthread_cond_destroy(&instance->condition);
+	pthread_mutex_destroy(&instance->lock);
+
+	free(instance->jobs);
+	free(instance->thread);
+	free(instance);
+}
\ No newline at end of file
@@ -0,0 +1,13 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdbool.h>
+
+typedef struct scheduler scheduler;
+typedef void (*scheduler_function)(void *context);
+
+scheduler *scheduler_init(int threads);
+bool scheduler_submit(scheduler *instance, long deadline, scheduler_function function, void *context);
+void scheduler_destroy(scheduler *instance);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,386 @@
+#include <arpa/inet.h>
+#include <endian.h>
+#include <limits.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "synchronizer.h"
+#include "timing.h"
+
+#define SYNC_MAGIC 0x50505359
+#define SYNC_HISTORY 16
+#define SYNC_WINDOW 64
+
+typedef struct __attribute__((packed))
+{
+	uint32_t magic;
+	int32_t source;
+	int32_t time;
+	int64_t shown;
+	int32_t next;
+	int64_t due;
+} synchronizer_packet;
+
+typedef struct synchronizer_entry
+{
+	int source;
+	int time;
+	long shown;
+	int next;
+	long due;
+} synchronizer_entry;
+
+struct synchronizer
+{
+	bool leader;
+	int socket;
+	struct sockaddr_storage address;
+	socklen_t addressLength;
+	bool warned;
+	synchronizer_entry received[SYNC_HISTORY];
+	long receivedCount;
+	synchronizer_entry shown[SYNC_HISTORY];
+	long shownCount;
+	long offset;
+	long windowOffset;
+	long previousOffset;
+	int windowLength;
+	int errors;
+	long errorTotal;
+	long errorMaximum;
+	bool destroyed;
+	pthread_mutex_t lock;
+	pthread_t thread;
+};
+
+// Called with the lock held. The leader clock is taken to be ahead of the local clock by the largest difference seen
+// between the time a frame was shown by the leader and the time its packet arrived, which is the difference seen with
+// the least delay. The estimate covers the current and previous windows so it can follow clocks that drift apart.
+
+static void update_offset(synchronizer *instance, long sample)
+{
+	if (instance->windowLength == 0 || sample > instance->windowOffset)
+	{
+		instance->windowOffset = sample;
+	}
+
+	instance->offset = instance->windowOffset > instance->previousOffset ? instance->windowOffset : instance->previousOffset;
+
+	if (++instance->windowLength == SYNC_WINDOW)
+	{
+		instance->previousOffset = instance->windowOffset;
+		instance->windowLength = 0;
+	}
+}
+
+// Called with the lock held. Each frame is matched once, by whichever of the leader packet and the local update came
+// second.
+
+static void match(synchronizer *instance, synchronizer_entry *history, long count, synchronizer_entry *entry, long expected)
+{
+	for (long index = count - 1; index >= 0 && index >= count - SYNC_HISTORY; index--)
+	{
+		synchronizer_entry *other = &history[index % SYNC_HISTORY];
+
+		if (other->source != entry->source || other->time != entry->time)
+		{
+			continue;
+		}
+
+		long error = other->shown - expected;
+		error = error < 0 ? -error : error;
+
+		instance->errors++;
+		instance->errorTotal += error;
+
+		if (error > instance->errorMaximum)
+		{
+			instance->errorMaximum = error;
+		}
+
+		return;
+	}
+}
+
+static void *synchronizer_process(void *parameter)
+{
+	synchronizer *instance = parameter;
+	pthread_mutex_lock(&instance->lock);
+
+	while (!instance->destroyed)
+	{
+		pthread_mutex_unlock(&instance->lock);
+
+		synchronizer_packet packet;
+		ssize_t length = recv(instance->socket, &packet, sizeof(packet), 0);
+		long received = get_precise_time();
+
+		pthread_mutex_lock(&instance->lock);
+
+		if (length != sizeof(packet) || ntohl(packet.magic) != SYNC_MAGIC)
+		{
+			continue;
+		}
+
+		synchronizer_entry entry = {
+			.source = (int32_t)ntohl(packet.source),
+			.time = (int32_t)ntohl(packet.time),
+			.shown = (int64_t)be64toh(packet.shown),
+			.next = (int32_t)ntohl(packet.next),
+			.due = (int64_t)be64toh(packet.due)
+		};
+
+		update_offset(instance, entry.shown - received);
+
+		instance->received[instance->receivedCount++ % SYNC_HISTORY] = entry;
+		match(instance, instance->shown, instance->shownCount, &entry, entry.shown - instance->offset);
+	}
+
+	pthread_mutex_unlock(&instance->lock);
+	return NULL;
+}
+
+synchronizer *synchronizer_init(char *address, bool leader)
+{
+	synchronizer *instance;
+
+	if ((instance = calloc(1, sizeof(*instance))) == NULL)
+	{
+		perror("Failed to allocate memory for instance");
+		return NULL;
+	}
+
+	instance->leader = leader;
+	instance->previousOffset = LONG_MIN;
+
+	// The leader sends to host:port, which may be a broadcast address, while followers listen on a port
+	char *port = strrchr(address, ':');
+	char *host = NULL;
+
+	if (leader)
+	{
+		if (port == NULL)
+		{
+			puts("Leader address must include a port!");
+			goto free_instance;
+		}
+
+		*port++ = 0;
+		host = address;
+	}
+	else
+	{
+		port = port == NULL ? address : port + 1;
+	}
+
+	struct addrinfo hints;
+	struct addrinfo *result;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = leader ? 0 : AI_PASSIVE;
+
+	int error = getaddrinfo(host, port, &hints, &result);
+
+	if (leader)
+	{
+		port[-1] = ':';
+	}
+
+	if (error)
+	{
+		printf("Failed to resolve sync address: %s\n", gai_strerror(error));
+		goto free_instance;
+	}
+
+	memcpy(&instance->address, result->ai_addr, result->ai_addrlen);
+	instance->addressLength = result->ai_addrlen;
+	freeaddrinfo(result);
+
+	if ((instance->socket = socket(AF_INET, SOCK_DGRAM, 0)) == -1)
+	{
+		perror("Failed to create sync socket");
+		goto free_instance;
+	}
+
+	int enable = 1;
+
+	if (leader)
+	{
+		if (setsockopt(instance->socket, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable)) == -1)
+		{
+			perror("Failed to enable broadcast");
+			goto close_socket;
+		}
+
+		return instance;
+	}
+
+	// Followers wake regularly so the receiving thread notices when it should stop
+	struct timeval timeout = {
+		.tv_usec = 100000
+	};
+
+	if (setsockopt(instance->socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) == -1 || setsockopt(instance->socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == -1)
+	{
+		perror("Failed to configure sync socket");
+		goto close_socket;
+	}
+
+	if (bind(instance->socket, (struct sockaddr *)&instance->address, instance->addressLength) == -1)
+	{
+		perror("Failed to bind sync socket");
+		goto close_socket;
+	}
+
+	for (int index = 0; index < SYNC_HISTORY; index++)
+	{
+		instance->received[index].source = -1;
+		instance->shown[index].source = -1;
+	}
+
+	pthread_mutex_init(&instance->lock, NULL);
+
+	if (pthread_create(&instance->thread, NULL, synchronizer_process, instance))
+	{
+		puts("Failed to create sync thread!");
+		goto destroy_mutex;
+	}
+
+	return instance;
+
+destroy_mutex:
+	pthread_mutex_destroy(&instance->lock);
+
+close_socket:
+	close(instance->socket);
+
+free_instance:
+	free(instance);
+	return NULL;
+}
+
+bool synchronizer_schedule(synchronizer *instance, int source, int time, long *due, bool *late)
+{
+	if (instance->leader)
+	{
+		return false;
+	}
+
+	pthread_mutex_lock(&instance->lock);
+
+	bool locked = false;
+	*late = false;
+
+	// Frames are placed relative to the time the leader planned to show the frame after the latest one it showed from
+	// the same source
+	for (long index = instance->receivedCount - 1; index >= 0 && index >= instance->receivedCount - SYNC_HISTORY; index--)
+	{
+		synchronizer_entry *entry = &instance->received[index % SYNC_HISTORY];
+
+		if (entry->source == source)
+		{
+			*due = entry->due - instance->offset + (time - entry->next) * 1000L;
+			locked = true;
+			break;
+		}
+
+		// A follower still playing a source the leader has finished is behind, so every frame is already late and is due
+		// straight away
+		if (entry->source > source)
+		{
+			*due = get_precise_time();
+			*late = true;
+			locked = true;
+		}
+	}
+
+	pthread_mutex_unlock(&instance->lock);
+	return locked;
+}
+
+void synchronizer_mark(synchronizer *instance, int source, int time, int next, long due)
+{
+	synchronizer_entry entry = {
+		.source = source,
+		.time = time,
+		.shown = get_precise_time(),
+		.next = next,
+		.due = due
+	};
+
+	if (instance->leader)
+	{
+		synchronizer_packet packet = {
+			.magic = htonl(SYNC_MAGIC),
+			.source = htonl(entry.source),
+			.time = htonl(entry.time),
+			.shown = htobe64(entry.shown),
+			.next = htonl(entry.next),
+			.due = htobe64(entry.due)
+		};
+
+		// Timing is sent without waiting, so a slow or missing network never holds up playback
+		if (sendto(instance->socket, &packet, sizeof(packet), MSG_DONTWAIT, (struct sockaddr *)&instance->address, instance->addressLength) == -1 && !instance->warned)
+		{
+			perror("Failed to send sync packet");
+			instance->warned = true;
+		}
+
+		return;
+	}
+
+	pthread_mutex_lock(&instance->lock);
+
+	instance->shown[instance->shownCount++ % SYNC_HISTORY] = entry;
+	match(instance, instance->received, instance->receivedCount, &entry, entry.shown + instance->offset);
+
+	pthread_mutex_unlock(&instance->lock);
+}
+
+void synchronizer_get_error(synchronizer *instance, int *frames, long *average, long *maximum)
+{
+	*frames = 0;
+	*average = 0;
+	*maximum = 0;
+
+	if (instance->leader)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&instance->lock);
+
+	*frames = instance->errors;
+	*average = instance->errors > 0 ? instance->errorTotal / instance->errors : 0;
+	*maximum = instance->errorMaximum;
+
+	instance->errors = 0;
+	instance->errorTotal = 0;
+	instance->errorMaximum = 0;
+
+	pthread_mutex_unlock(&instance->lock);
+}
+
+void synchronizer_destroy(synchronizer *instance)
+{
+	if (!instance->leader)
+	{
+		pthread_mutex_lock(&instance->lock);
+		instance->destroyed = true;
+		pthread_mutex_unlock(&instance->lock);
+
+		pthread_join(instance->thread, NULL);
+		pthread_mutex_destroy(&instance->lock);
+	}
+
+	close(instance->socket);
+	free(instance);
+}
\ No newline at end of file
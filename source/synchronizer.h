@@ -0,0 +1,14 @@
+#ifndef SYNCHRONIZER_H
+#define SYNCHRONIZER_H
+
+#include <stdbool.h>
+
+typedef struct synchronizer synchronizer;
+
+synchronizer *synchronizer_init(char *address, bool leader);
+bool synchronizer_schedule(synchronizer *instance, int source, int time, long *due, bool *late);
+void synchronizer_mark(synchronizer *instance, int source, int time, int next, long due);
+void synchronizer_get_error(synchronizer *instance, int *frames, long *average, long *maximum);
+void synchronizer_destroy(synchronizer *instance);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,38 @@
+#include <time.h>
+#include <unistd.h>
+
+#include "timing.h"
+
+long get_time()
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000 + time.tv_nsec / 1000000;
+}
+
+long get_precise_time()
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000000 + time.tv_nsec / 1000;
+}
+
+void await(long time)
+{
+	long delay = time - get_time();
+
+	if (delay > 0)
+	{
+		usleep(delay * 1000);
+	}
+}
+
+void await_precise(long time)
+{
+	long delay = time - get_precise_time();
+
+	if (delay > 0)
+	{
+		usleep(delay);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,13 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#define UPDATE_DELAY 10
+#define HOLD_DELAY 100
+#define REPORT_DELAY 10000
+
+long get_time();
+long get_precise_time();
+void await(long time);
+void await_precise(long time);
+
+#endif
\ No newline at end of file
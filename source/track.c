@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decoder.h"
+#include "frame.h"
+#include "track.h"
+
+struct track
+{
+	pool *pool;
+	void *file;
+	decoder *decoder;
+	int size;
+	int rate;
+	int frames;
+	int duration;
+	int count;
+	uint8_t *current;
+	int start;
+	int end;
+	uint8_t *held;
+	bool lookahead;
+	int lookaheadEnd;
+};
+
+static uint8_t *decode(track *instance, int *end, decoder_ready_function ready, void *context)
+{
+	uint8_t *frame = ready == NULL ? decoder_get_next(instance->decoder, end) : decoder_stream_next(instance->decoder, end, ready, context);
+
+	if (instance->rate > 0)
+	{
+		*end = ++instance->count * 1000 / instance->rate;
+	}
+
+	return frame;
+}
+
+track *track_init(void *file, int size, int width, int height, int rate, bool interpolate, int threads, scheduler *scheduler, pool *pool)
+{
+	track *instance;
+
+	if ((instance = calloc(1, sizeof(*instance))) == NULL)
+	{
+		perror("Failed to allocate memory for instance");
+		return NULL;
+	}
+
+	if ((instance->decoder = decoder_init(file, size, width, height, threads, scheduler, pool)) == NULL)
+	{
+		goto free_instance;
+	}
+
+	int canvasWidth;
+	int canvasHeight;
+
+	decoder_get_info(instance->decoder, &instance->frames, &instance->duration, &canvasWidth, &canvasHeight);
+
+	if (rate > 0)
+	{
+		instance->duration = instance->frames * 1000 / rate;
+	}
+
+	// Interpolation keeps a copy of the current frame while the decoder canvas holds the one after it
+	if (interpolate && (instance->held = pool_get_reserved(pool, width * height * 4)) == NULL)
+	{
+		puts("Failed to get buffer for held frame!");
+		goto destroy_decoder;
+	}
+
+	instance->pool = pool;
+	instance->file = file;
+	instance->size = width * height * 4;
+	instance->rate = rate;
+
+	return instance;
+
+destroy_decoder:
+	decoder_destroy(instance->decoder);
+
+free_instance:
+	free(instance);
+	return NULL;
+}
+
+void track_get_info(track *instance, int *frames, int *duration, int *canvasWidth, int *canvasHeight)
+{
+	int sourceDuration;
+
+	decoder_get_info(instance->decoder, frames, &sourceDuration, canvasWidth, canvasHeight);
+	*duration = instance->duration;
+}
+
+bool track_has_next(track *instance)
+{
+	return decoder_has_next(instance->decoder);
+}
+
+uint8_t *track_get_next(track *instance, int *end)
+{
+	return track_stream_next(instance, end, NULL, NULL);
+}
+
+uint8_t *track_stream_next(track *instance, int *end, decoder_ready_function ready, void *context)
+{
+	instance->start = instance->end;
+	instance->current = decode(instance, &instance->end, ready, context);
+	*end = instance->end;
+
+	return instance->current;
+}
+
+uint8_t *track_sample(track *instance, int time, uint8_t **following, int *weight, int *end)
+{
+	if (instance->held == NULL)
+	{
+		while (instance->current == NULL || (instance->end <= time && decoder_has_next(instance->decoder)))
+		{
+			if (track_get_next(instance, end) == NULL)
+			{
+				return NULL;
+			}
+		}
+
+		if (following != NULL)
+		{
+			*following = instance->current;
+			*weight = 0;
+		}
+
+		*end = instance->end;
+		return instance->current;
+	}
+
+	if (instance->current == NULL)
+	{
+		if ((instance->current = decode(instance, &instance->end, NULL, NULL)) == NULL)
+		{
+			return NULL;
+		}
+
+		memcpy(instance->held, instance->current, instance->size);
+		instance->lookahead = false;
+
+		if (decoder_has_next(instance->decoder))
+		{
+			if ((instance->current = decode(instance, &instance->lookaheadEnd, NULL, NULL)) == NULL)
+			{
+				return NULL;
+			}
+
+			instance->lookahead = true;
+		}
+	}
+
+	// The held frame is replaced by the lookahead frame once playback reaches it
+	while (instance->lookahead && instance->end <= time)
+	{
+		memcpy(instance->held, instance->current, instance->size);
+		instance->start = instance->end;
+		instance->end = instance->lookaheadEnd;
+		instance->lookahead = false;
+
+		if (decoder_has_next(instance->decoder))
+		{
+			if ((instance->current = decode(instance, &instance->lookaheadEnd, NULL, NULL)) == NULL)
+			{
+				return NULL;
+			}
+
+			instance->lookahead = true;
+		}
+	}
+
+	*following = instance->lookahead ? instance->current : instance->held;
+	*weight = 0;
+
+	if (instance->lookahead && instance->end > instance->start && time > instance->start)
+	{
+		*weight = (time - instance->start) * FADE_MAXIMUM / (instance->end - instance->start);
+	}
+
+	*end = instance->end;
+	return instance->held;
+}
+
+void track_destroy(track *instance)
+{
+	pool_release(instance->pool, instance->held);
+	decoder_destroy(instance->decoder);
+	pool_release(instance->pool, instance->file);
+	free(instance);
+}
\ No newline at end of file
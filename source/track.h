@@ -0,0 +1,21 @@
+#ifndef TRACK_H
+#define TRACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "decoder.h"
+#include "pool.h"
+#include "scheduler.h"
+
+typedef struct track track;
+
+track *track_init(void *file, int size, int width, int height, int rate, bool interpolate, int threads, scheduler *scheduler, pool *pool);
+void track_get_info(track *instance, int *frames, int *duration, int *canvasWidth, int *canvasHeight);
+bool track_has_next(track *instance);
+uint8_t *track_get_next(track *instance, int *end);
+uint8_t *track_stream_next(track *instance, int *end, decoder_ready_function ready, void *context);
+uint8_t *track_sample(track *instance, int time, uint8_t **following, int *weight, int *end);
+void track_destroy(track *instance);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "workers.h"
+
+typedef struct workers_job
+{
+	workers_function function;
+	void *context;
+	int items;
+	uint32_t generation;
+} workers_job;
+
+struct workers
+{
+	int threads;
+	int capacity;
+	pthread_t *thread;
+	workers_job job;
+	atomic_uint_fast64_t next;
+	bool *finished;
+	int completed;
+	int active;
+	bool destroyed;
+	pthread_mutex_t lock;
+	pthread_cond_t condition;
+	pthread_cond_t completion;
+};
+
+// Items are claimed one at a time from a shared counter, so a thread that falls behind simply claims fewer of them
+// instead of holding up the rest of the job. The counter holds the generation of the job in its upper half, so a thread
+// that picked up a job just as it finished can never claim an item of the job started after it.
+
+static bool workers_run_next(workers *instance, workers_job *job)
+{
+	uint64_t claim = atomic_load(&instance->next);
+
+	do
+	{
+		if (claim >> 32 != job->generation || (claim & UINT32_MAX) >= job->items)
+		{
+			return false;
+		}
+	}
+	while (!atomic_compare_exchange_weak(&instance->next, &claim, claim + 1));
+
+	int item = claim & UINT32_MAX;
+	job->function(job->context, item);
+
+	pthread_mutex_lock(&instance->lock);
+
+	instance->finished[item] = true;
+	instance->completed++;
+	pthread_cond_broadcast(&instance->completion);
+
+	pthread_mutex_unlock(&instance->lock);
+	return true;
+}
+
+static void *workers_process(void *parameter)
+{
+	workers *instance = parameter;
+	uint32_t generation = 0;
+
+	pthread_mutex_lock(&instance->lock);
+
+	while (true)
+	{
+		while (!instance->destroyed && generation == instance->job.generation)
+		{
+			pthread_cond_wait(&instance->condition, &instance->lock);
+		}
+
+		if (instance->destroyed)
+		{
+			break;
+		}
+
+		// The job is copied while the lock is held, as the next one may be started as soon as this one has finished
+		workers_job job = instance->job;
+
+		generation = job.generation;
+		instance->active++;
+		pthread_mutex_unlock(&instance->lock);
+
+		while (workers_run_next(instance, &job));
+
+		pthread_mutex_lock(&instance->lock);
+		instance->active--;
+		pthread_cond_broadcast(&instance->completion);
+	}
+
+	pthread_mutex_unlock(&instance->lock);
+	return NULL;
+}
+
+workers *workers_init(int threads, int capacity)
+{
+	workers *instance;
+
+	if ((instance = calloc(1, sizeof(*instance))) == NULL)
+	{
+		perror("Failed to allocate memory for instance");
+		return NULL;
+	}
+
+	instance->capacity = capacity;
+
+	if ((instance->finished = calloc(capacity, sizeof(*instance->finished))) == NULL)
+	{
+		perror("Failed to allocate memory for items");
+		goto free_instance;
+	}
+
+	// The calling thread always takes part, so one fewer thread is created than requested
+	if ((instance->thread = calloc(threads, sizeof(*instance->thread))) == NULL)
+	{
+		perror("Failed to allocate memory for threads");
+		goto free_finished;
+	}
+
+	pthread_mutex_init(&instance->lock, NULL);
+	pthread_cond_init(&instance->condition, NULL);
+	pthread_cond_init(&instance->completion, NULL);
+
+	for (instance->threads = 1; instance->threads < threads; instance->threads++)
+	{
+		if (pthread_create(&instance->thread[instance->threads], NULL, workers_process, instance))
+		{
+			puts("Failed to create worker thread!");
+			goto join_threads;
+		}
+	}
+
+	return instance;
+
+join_threads:
+	pthread_mutex_lock(&instance->lock);
+
+	instance->destroyed = true;
+	pthread_cond_broadcast(&instance->condition);
+
+	pthread_mutex_unlock(&instance->lock);
+
+	for (int thread = 1; thread < instance->threads; thread++)
+	{
+		pthread_join(instance->thread[thread], NULL);
+	}
+
+	pthread_cond_destroy(&instance->completion);
+	pthread_cond_destroy(&instance->condition);
+	pthread_mutex_destroy(&instance->lock);
+
+	free(instance->thread);
+
+free_finished:
+	free(instance->finished);
+
+free_instance:
+	free(instance);
+	return NULL;
+}
+
+int workers_get_threads(workers *instance)
+{
+	return instance->threads;
+}
+
+void workers_start(workers *instance, workers_function function, void *context, int items)
+{
+	pthread_mutex_lock(&instance->lock);
+
+	instance->job.function = function;
+	instance->job.context = context;
+	instance->job.items = items < instance->capacity ? items : instance->capacity;
+	instance->job.generation++;
+	instance->completed = 0;
+
+	memset(instance->finished, 0, instance->job.items * sizeof(*instance->finished));
+	atomic_store(&instance->next, (uint64_t)instance->job.generation << 32);
+
+	pthread_cond_broadcast(&instance->condition);
+	pthread_mutex_unlock(&instance->lock);
+}
+
+void workers_wait(workers *instance, int item)
+{
+	// The calling thread works through unclaimed items until the one it needs is ready
+	while (true)
+	{
+		pthread_mutex_lock(&instance->lock);
+		bool finished = instance->finished[item];
+		pthread_mutex_unlock(&instance->lock);
+
+		if (finished || !workers_run_next(instance, &instance->job))
+		{
+			break;
+		}
+	}
+
+	pthread_mutex_lock(&instance->lock);
+
+	while (!instance->finished[item])
+	{
+		pthread_cond_wait(&instance->completion, &instance->lock);
+	}
+
+	pthread_mutex_unlock(&instance->lock);
+}
+
+void workers_finish(workers *instance)
+{
+	while (workers_run_next(instance, &instance->job));
+
+	pthread_mutex_lock(&instance->lock);
+
+	// Threads still leaving the previous job must be done with it before the next one can be started
+	while (instance->completed < instance->job.items || instance->active > 0)
+	{
+		pthread_cond_wait(&instance->completion, &instance->lock);
+	}
+
+	pthread_mutex_unlock(&instance->lock);
+}
+
+void workers_destroy(workers *instance)
+{
+	pthread_mutex_lock(&instance->lock);
+
+	instance->destroyed = true;
+	pthread_cond_broadcast(&instance->condition);
+
+	pthread_mutex_unlock(&instance->lock);
+
+	for (int thread = 1; thread < instance->threads; thread++)
+	{
+		pthread_join(instance->thread[thread], NULL);
+	}
+
+	pthread_cond_destroy(&instance->completion);
+	pthread_cond_destroy(&instance->condition);
+	pthread_mutex_destroy(&instance->lock);
+
+	free(instance->thread);
+	free(instance->finished);
+	free(instance);
+}
\ No newline at end of file
@@ -0,0 +1,16 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <stdbool.h>
+
+typedef struct workers workers;
+typedef void (*workers_function)(void *context, int item);
+
+workers *workers_init(int threads, int capacity);
+int workers_get_threads(workers *instance);
+void workers_start(workers *instance, workers_function function, void *context, int items);
+void workers_wait(workers *instance, int item);
+void workers_finish(workers *instance);
+void workers_destroy(workers *instance);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,213 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "loader.h"
+#include "track.h"
+#include "zone.h"
+
+struct zone
+{
+	pool *pool;
+	loader *loader;
+	char **sources;
+	int sourcesLength;
+	int x;
+	int y;
+	int width;
+	int height;
+	int rate;
+	bool shuffle;
+	bool repeat;
+	bool verbose;
+	int queued;
+	int opened;
+	track *track;
+	int frames;
+	uint8_t *frame;
+	int end;
+	long due;
+	long length;
+	bool holding;
+};
+
+static track *open_next(zone *instance)
+{
+	// Every source is tried at most once before giving up so a playlist of broken files can't stall playback
+	for (int attempt = 0; attempt < instance->sourcesLength; attempt++)
+	{
+		bool limited = !instance->shuffle && !instance->repeat;
+
+		if (limited && instance->opened >= instance->sourcesLength)
+		{
+			return NULL;
+		}
+
+		while (instance->queued < instance->opened + QUEUE_SIZE && (!limited || instance->queued < instance->sourcesLength))
+		{
+			int source = instance->shuffle ? rand() % instance->sourcesLength : instance->queued % instance->sourcesLength;
+
+			loader_add(instance->loader, instance->sources[source]);
+			instance->queued++;
+		}
+
+		void *file;
+		int size;
+
+		instance->opened++;
+
+		if ((file = loader_get(instance->loader, &size)) == NULL)
+		{
+			continue;
+		}
+
+		track *track;
+
+		if ((track = track_init(file, size, instance->width, instance->height, instance->rate, false, 1, NULL, instance->pool)) == NULL)
+		{
+			puts("Failed to decode file!");
+			pool_release(instance->pool, file);
+			continue;
+		}
+
+		int duration;
+		int canvasWidth;
+		int canvasHeight;
+
+		track_get_info(track, &instance->frames, &duration, &canvasWidth, &canvasHeight);
+
+		if (instance->verbose)
+		{
+			printf("Decoding %d frames at a resolution of %dx%d for zone at %d,%d.\n", instance->frames, canvasWidth, canvasHeight, instance->x, instance->y);
+		}
+
+		if (canvasWidth < instance->width || canvasHeight < instance->height)
+		{
+			puts("Image is smaller than zone!");
+			track_destroy(track);
+			continue;
+		}
+
+		return track;
+	}
+
+	return NULL;
+}
+
+zone *zone_init(char **sources, int sourcesLength, int x, int y, int width, int height, int rate, bool shuffle, bool repeat, long start, scheduler *scheduler, pool *pool, bool verbose)
+{
+	zone *instance;
+
+	if ((instance = calloc(1, sizeof(*instance))) == NULL)
+	{
+		perror("Failed to allocate memory for instance");
+		return NULL;
+	}
+
+	if ((instance->loader = loader_init(QUEUE_SIZE, pool, scheduler)) == NULL)
+	{
+		puts("Failed to create loader instance!");
+		goto free_instance;
+	}
+
+	instance->pool = pool;
+	instance->sources = sources;
+	instance->sourcesLength = sourcesLength;
+	instance->x = x;
+	instance->y = y;
+	instance->width = width;
+	instance->height = height;
+	instance->rate = rate;
+	instance->shuffle = shuffle;
+	instance->repeat = repeat;
+	instance->verbose = verbose;
+	instance->due = start;
+
+	return instance;
+
+free_instance:
+	free(instance);
+	return NULL;
+}
+
+void zone_get_area(zone *instance, int *x, int *y, int *width, int *height)
+{
+	*x = instance->x;
+	*y = instance->y;
+	*width = instance->width;
+	*height = instance->height;
+}
+
+uint8_t *zone_get_frame(zone *instance, long *due)
+{
+	*due = instance->frame == NULL || instance->holding ? LONG_MAX : instance->due;
+	return instance->frame;
+}
+
+long zone_get_next_due(zone *instance)
+{
+	return instance->frame == NULL ? instance->due : instance->due + instance->length;
+}
+
+bool zone_advance(zone *instance, long now)
+{
+	if (instance->frame != NULL)
+	{
+		instance->due += instance->length;
+	}
+
+	// A zone that has fallen behind continues from now rather than rushing through the frames it missed
+	if (instance->due < now)
+	{
+		instance->due = now;
+	}
+
+	while (true)
+	{
+		if (instance->track != NULL && track_has_next(instance->track))
+		{
+			int end;
+			uint8_t *frame = track_get_next(instance->track, &end);
+
+			if (frame != NULL)
+			{
+				instance->length = end > instance->end ? end - instance->end : 0;
+				instance->end = end;
+				instance->frame = frame;
+
+				return true;
+			}
+		}
+
+		// A static image that is the only source of a zone stays on show rather than being reloaded
+		if (instance->track != NULL && instance->frames == 1 && instance->sourcesLength == 1)
+		{
+			instance->holding = true;
+			return true;
+		}
+
+		if (instance->track != NULL)
+		{
+			track_destroy(instance->track);
+		}
+
+		instance->frame = NULL;
+		instance->end = 0;
+
+		if ((instance->track = open_next(instance)) == NULL)
+		{
+			return false;
+		}
+	}
+}
+
+void zone_destroy(zone *instance)
+{
+	if (instance->track != NULL)
+	{
+		track_destroy(instance->track);
+	}
+
+	loader_destroy(instance->loader);
+	free(instance);
+}
\ No newline at end of file
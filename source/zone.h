@@ -0,0 +1,19 @@
+#ifndef ZONE_H
+#define ZONE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pool.h"
+#include "scheduler.h"
+
+typedef struct zone zone;
+
+zone *zone_init(char **sources, int sourcesLength, int x, int y, int width, int height, int rate, bool shuffle, bool repeat, long start, scheduler *scheduler, pool *pool, bool verbose);
+void zone_get_area(zone *instance, int *x, int *y, int *width, int *height);
+uint8_t *zone_get_frame(zone *instance, long *due);
+long zone_get_next_due(zone *instance);
+bool zone_advance(zone *instance, long now);
+void zone_destroy(zone *instance);
+
+#endif
\ No newline at end of file